@@ -7,12 +7,35 @@
  *
  * Change Background Color:
  * /BACK [color_code]
- * Example: /BACK B   (Changes background color to Dark Blue)
+ * Example: /BACK B   (Changes background color to Dark Blue; the old background is recolored in place, text and graphics kept)
  *
  * Clear Screen:
  * /CLS
  * Example: /CLS
  *
+ * Scrollback:
+ * /SCROLLBACK [lines|CLEAR]
+ * Example: /SCROLLBACK 20   (Shows the console as it was 20 lines ago; console output returns to the live view)
+ * Example: /SCROLLBACK 0   (Returns to the live view)
+ * Example: /SCROLLBACK   (Reports how many lines are stored)
+ *
+ * Virtual Console:
+ * /VC [n]
+ * Example: /VC 2   (Shows console 2 and sends console output to it)
+ * Example: /VC   (Reports the console shown and the one receiving output)
+ *
+ * Text Window:
+ * /WINDOW [id [col row width height [NOWRAP]|CLEAR|OFF]]
+ * Example: /WINDOW 1 41 2 40 10   (Defines window 1 at column 41, row 2, 40 columns by 10 rows, and clears it)
+ * Example: /WINDOW 1   (Sends console text to window 1; /WINDOW 0 sends it back to the console)
+ * Example: /WINDOW 1 CLEAR   (Clears window 1 and homes its cursor)
+ * Example: /WINDOW   (Lists the windows)
+ *
+ * Scroll Region:
+ * /SCROLLREGION [top bottom]
+ * Example: /SCROLLREGION 3 28   (Only console rows 3 to 28 scroll; rows 1-2 and 29-30 stay put)
+ * Example: /SCROLLREGION   (The whole console scrolls again)
+ *
  * Draw Line:
  * /LINE x1 y1 x2 y2 color
  * Example: /LINE 10 10 100 100 R   (Draws a red line from coordinates (10,10) to (100,100))
@@ -25,6 +48,10 @@
  * /FILLRECT x y width height color
  * Example: /FILLRECT 50 50 100 100 B   (Draws and fills a dark blue rectangle with top-left corner at (50,50) and size 100x100)
  *
+ * Recolor:
+ * /RECOLOR x y width height from_color to_color
+ * Example: /RECOLOR 0 0 640 480 K B   (Turns every black pixel on the screen dark blue)
+ *
  * Draw Circle:
  * /CIRCLE x y radius color
  * Example: /CIRCLE 200 200 50 Y   (Draws a yellow circle with center at (200,200) and radius 50)
@@ -43,8 +70,8 @@
  *
  * Set Font:
  * /FONT [type]
- * Example: /FONT STANDARD   (Sets the font to Standard 5x7)
- * Example: /FONT BRL4   (Sets the font to BRL4)
+ * Example: /FONT STANDARD   (Sets the font to Standard 5x7, a 106x60 console of 6x8 cells)
+ * Example: /FONT BRL4   (Sets the font to BRL4, an 80x30 console of 8x16 cells)
  *
  * Draw Smiley:
  * /SMILEY
@@ -66,21 +93,119 @@
  * /PETSCII x y color text
  * Example: /PETSCII 50 50 Y HELLO, WORLD!   (Draws the text "HELLO, WORLD!" at coordinates (50,50) in yellow)
  *
- * ANSI Escape Codes:
+ * Deferred (Vblank-Synchronized) Mode:
+ * /DEFER [ON|OFF]
+ * Example: /DEFER ON   (Queues commands and text, and applies them starting at each vsync)
+ * Example: /DEFER   (Reports the queue state and statistics)
+ *
+ * Per-Frame Budget:
+ * /BUDGET microseconds
+ * Example: /BUDGET 1400   (Stops draining the queue 1400us after vsync; the rest waits for the next frame)
+ *
+ * Atomic Group:
+ * /GROUP ... /ENDGROUP
+ * Example: /GROUP   (The commands up to /ENDGROUP are applied together within one frame)
+ *
+ * Transaction:
+ * /BEGIN ... /COMMIT   (or the bytes STX 0x02 ... ETX 0x03)
+ * Example: /BEGIN   (Buffers the following commands without echo; /COMMIT applies them as one batch)
+ *
+ * Measure Input-to-Photon Latency:
+ * /LATENCY [ON|OFF|RESET]
+ * Example: /LATENCY ON   (Starts measuring the time from a command's last byte until its pixels are scanned out)
+ * Example: /LATENCY   (Reports min/avg/p99/max latency in microseconds)
+ *
+ * Damage Tracking:
+ * /DAMAGE [ON|OFF|CLEAR]
+ * Example: /DAMAGE ON   (Starts recording which pixels the drawing primitives change)
+ * Example: /DAMAGE   (Lists the changed area as x y width height rectangles)
+ *
+ * Flow Control:
+ * /FLOW [NONE|XON|RTS|CREDIT]
+ * Example: /FLOW CREDIT   (Grants the host receive space with ACK 0x06 n, n * 64 bytes each; disables echo)
+ * Example: /FLOW   (Reports receive ring use, overruns and outstanding credit)
+ *
+ * Line Rate:
+ * /BAUD [rate|AUTO]
+ * Example: /BAUD 921600   (Switches the UART to 921600 baud after the reply has been sent)
+ * Example: /BAUD AUTO   (Times a stream of 0x55 bytes sent by the host and switches to the nearest supported rate)
+ * Example: /BAUD   (Reports the current rate and the divisor error of every supported rate)
+ *
+ * Parallel Bus Input:
+ * /PARALLEL [ON|OFF]
+ * Example: /PARALLEL ON   (Accepts commands and text on D0-D7 = GPIO 6-13, /STROBE = GPIO 14, BUSY = GPIO 15)
+ * Example: /PARALLEL   (Reports the bytes received and how often the ring filled up)
+ *
+ * SPI Slave Input:
+ * /SPI [ON|OFF]
+ * Example: /SPI ON   (Accepts commands and text as an SPI mode 3 slave: MOSI = GPIO 4, /CS = GPIO 5, SCK = GPIO 22, READY = GPIO 26)
+ * Example: /SPI   (Reports the bytes received, how often the ring filled up and receive overruns)
+ *
+ * TMS9918A Emulation:
+ * /VDP [ON]
+ * Example: /VDP ON   (The following input is TMS9918A port records: 'D' n data, 'C' v, 'R' n, 'S', and 'X' to exit)
+ * Example: /VDP   (Reports the registers, status and render time)
+ *
+ * CRTC Text Mode:
+ * /CRTC [ON]
+ * Example: /CRTC ON   (The following input is 6845-style register and character/attribute RAM writes, 0xFF exits)
+ * Example: /CRTC   (Reports the start address, cursor address and cells drawn)
+ *
+ * Console Drawing:
+ * /CONSOLE [BATCHED|IMMEDIATE|GLYPHS n]
+ * Example: /CONSOLE BATCHED   (Console text is drawn once per frame, only the cells that changed; the default)
+ * Example: /CONSOLE IMMEDIATE   (Every character is drawn as it arrives)
+ * Example: /CONSOLE GLYPHS 32   (Uses at most 32 glyph cache entries, 0 turns the cache off)
+ * Example: /CONSOLE   (Reports characters received, cells drawn, flushes and the glyph cache hit rate)
+ *
+ * Text Cursor:
+ * /CURSOR [BLOCK|UNDERLINE|OFF] [frames]
+ * Example: /CURSOR UNDERLINE 15   (Underline cursor, on for 15 frames and off for 15)
+ * Example: /CURSOR BLOCK 0   (Steady block cursor)
+ * Example: /CURSOR   (Reports the shape and blink rate)
+ *
+ * Dump Trace Ring:
+ * /TRACE [CLEAR]
+ * Example: /TRACE   (Prints the event trace ring, see tools/trace2chrome.py)
+ * Example: /TRACE CLEAR   (Empties the event trace ring)
+ *
+ * Binary Memory Port (DLE = 0x10, values big-endian):
+ * DLE 'A' a2 a1 a0   (Sets the port address: 0x000000 framebuffer, 0x400000 screen_buffer, 0x800000 tile_map)
+ * DLE 'S' s1 s0   (Sets the signed address step, default 1)
+ * DLE 'W' n2 n1 n0 data   (Writes n raw bytes)
+ * DLE 'R' n2 n1 n0   (Sends n raw bytes back)
+ *
+ * ANSI Escape Codes (VT100 subset, parameters default to 1):
  * 
  * Cursor Position:
  * \033[row;colH
  * Example: \033[10;20H   (Moves the cursor to row 10, column 20)
+ * \033[nA, \033[nB, \033[nC, \033[nD   (Cursor up, down, right, left)
+ * \033[nG, \033[nd   (Cursor to column n, to row n)
+ * \033[s, \033[u, \0337, \0338   (Save and restore the cursor and colors)
  *
  * Clear Screen:
  * \033[2J
  * Example: \033[2J   (Clears the entire screen)
+ * \033[0J, \033[1J   (Erases to the end, from the start of the screen)
+ * \033[0K, \033[1K, \033[2K   (Erases to the end, from the start, all of the line)
+ * \033[nX   (Erases n characters)
+ *
+ * Insert and Delete:
+ * \033[nL, \033[nM   (Inserts, deletes n lines inside the scroll region)
+ * \033[n@, \033[nP   (Inserts, deletes n characters)
+ *
+ * Scroll Region:
+ * \033[top;bottomr
+ * Example: \033[2;29r   (Only rows 2 to 29 scroll)
  *
  * Set Text Attributes:
- * \033[attribute_code m
+ * \033[attribute_code;...m
  * Example: \033[31m   (Sets the text color to red)
+ * Example: \033[97;44m   (Bright white on dark blue)
+ * Example: \033[1;4m   (Bold underlined text; 7 reverses, 22, 24, 27 undo them)
  * 
- * Text Color Codes:
+ * Text Color Codes (40-47 for the background, 90-97 and 100-107 bright, 0 reset):
  * 30 - Black, 31 - Red, 32 - Dark Green, 33 - Yellow, 34 - Dark Blue
  * 35 - Magenta, 36 - Cyan, 37 - White
  *
@@ -97,6 +222,20 @@
 #include "pico/stdlib.h"
 #include "hardware/uart.h"
 #include "vga16_graphics.h"
+#include "trace.h"
+#include "latency.h"
+#include "cmdqueue.h"
+#include "serial_rx.h"
+#include "transport.h"
+#include "parallel.h"
+#include "spi_slave.h"
+#include "vram_port.h"
+#include "vdp.h"
+#include "crtc.h"
+#include "ansi.h"
+#include "cell.h"
+#include "scrollback.h"
+#include "glyph_cache.h"
 #include <stdbool.h>
 
 extern unsigned short cursor_y, cursor_x;
@@ -128,14 +267,13 @@ extern unsigned char textsize;
 #define LIGHT_PINK 0xE
 #define WHITE 0xF
 
-typedef struct {
-    char character;
-    char color;
-    char bgcolor;
-    bool is_sprite;
-} Tile;
+// Tile map: packed cells, with a bit per cell marking sprite tiles
+Cell tile_map[ROWS][COLS];
+uint32_t tile_sprites[ROWS][(COLS + 31) / 32];
 
-Tile tile_map[ROWS][COLS];
+static inline bool tile_is_sprite(int row, int col) {
+    return tile_sprites[row][col >> 5] & (1u << (col & 31));
+}
 
 // Forward declarations
 void redraw_screen();
@@ -144,6 +282,8 @@ void render_tile_map();
 void set_tile(int row, int col, char character, char color, char bgcolor, bool is_sprite);
 void drawImage(int x, int y, int width, int height, const char* image);
 void drawPETSCIIChar(int x, int y, uint8_t c, char color); // Add this line
+void reply(const char *text);
+void move_cursor(int row, int col);
 
 char parse_color_code(const char *color_code) {
     if (strcmp(color_code, "R") == 0 || strcmp(color_code, "RED") == 0) return RED;
@@ -167,21 +307,79 @@ char parse_color_code(const char *color_code) {
 }
 
 
-typedef struct {
-    char character;
-    char color;
-    char bgcolor;
-    bool is_standard_font; // Track if the character uses the standard font or BRL4
-} ScreenCell;
-
-ScreenCell screen_buffer[ROWS][COLS];
-ScreenCell spriteBackground[8][8];
+// Console: packed cells, plus an attribute plane with the flags of each cell
+#define ATTR_BIG_FONT 0x01  // drawn with the 8x16 BRL4 font rather than the 5x7 one
+#define ATTR_STYLE_SHIFT 1  // bits 1-3: the VGA_STYLE_* flags (SGR 1, 4, 7) of the cell
+
+// Console geometry follows the font: 6x8 cells (106x60) for the 5x7 font,
+// 8x16 cells (80x30) for BRL4. The tile map keeps the fixed 8x16 grid.
+#define MAX_COLS (SCREEN_WIDTH / 6)
+#define MAX_ROWS (SCREEN_HEIGHT / 8)
+
+int cell_width = 6, cell_height = 8;
+int console_cols = MAX_COLS, console_rows = MAX_ROWS;
+
+// Virtual consoles, each with its own cells; screen_buffer and screen_attr
+// point at the planes of the one receiving output. Rows are MAX_COLS cells
+// apart at any width, and the consoles share a pool of VC_COUNT 80x30
+// consoles' rows, so there are half as many consoles at 106x60.
+#ifndef VC_COUNT
+#define VC_COUNT 4
+#endif
+#define VC_ROWS (VC_COUNT * ROWS)
+
+static Cell vc_cells[VC_ROWS][MAX_COLS];
+static uint8_t vc_attr[VC_ROWS][MAX_COLS];
+Cell (*screen_buffer)[MAX_COLS] = vc_cells;
+uint8_t (*screen_attr)[MAX_COLS] = vc_attr;
+int vc_count = VC_ROWS / MAX_ROWS;  // consoles at the current geometry
+int vc_active = 0;      // console receiving output
+int vc_shown = 0;       // console on the screen
+Cell spriteBackground[8][8];
+uint8_t spriteBackgroundAttr[8][8];
 
 int cursor_row = 0;
 int cursor_col = 0;
 char current_bg_color = BLACK;
 char current_text_color = GREEN;
 bool use_standard_font = true; // Declare globally
+uint8_t current_style = 0;      // VGA_STYLE_* flags set by SGR
+
+static inline Cell current_cell(char c) {
+    return cell_make(c, current_text_color, current_bg_color);
+}
+
+// Attributes of blank cells: the font only, erasing never underlines or reverses
+static inline uint8_t current_attr() {
+    return use_standard_font ? 0 : ATTR_BIG_FONT;
+}
+
+// Attributes of written text: the font and the SGR style
+static inline uint8_t text_attr() {
+    return current_attr() | (current_style << ATTR_STYLE_SHIFT);
+}
+
+// Draw one cell, background included, with the cell blitter for its font,
+// which applies its style in the same pass
+static inline void blit_cell(short x, short y, Cell cell, uint8_t attr) {
+    uint8_t style = attr >> ATTR_STYLE_SHIFT;
+    if (attr & ATTR_BIG_FONT) {
+        drawCharCell(x, y, cell_char(cell), cell_fg(cell), cell_bg(cell), style, 0);
+    } else {
+        drawCharCell6(x, y, cell_char(cell), cell_fg(cell), cell_bg(cell), style);
+    }
+}
+
+// Colors that SGR 0, 39 and 49 go back to (set by /TEXT and /BACK)
+char default_text_color = GREEN;
+char default_bg_color = BLACK;
+
+// Rows that scroll (DECSTBM), inclusive
+int scroll_top = 0;
+int scroll_bottom = MAX_ROWS - 1;
+
+// Lines the view is scrolled back into history, 0 for the live console
+int scrollback_offset = 0;
 
 const uint8_t smiley[8] = {
     0b00111100,
@@ -202,14 +400,13 @@ void saveBackground(int x, int y) {
             int row = y + i;
             int col = x + j;
             if (row < SCREEN_HEIGHT && col < SCREEN_WIDTH) {
-                int screen_row = row / CHAR_HEIGHT;
-                int screen_col = col / CHAR_WIDTH;
+                int screen_row = row / cell_height;
+                int screen_col = col / cell_width;
                 spriteBackground[i][j] = screen_buffer[screen_row][screen_col];
+                spriteBackgroundAttr[i][j] = screen_attr[screen_row][screen_col];
             } else {
-                spriteBackground[i][j].character = ' ';
-                spriteBackground[i][j].color = current_bg_color;
-                spriteBackground[i][j].bgcolor = current_bg_color;
-                spriteBackground[i][j].is_standard_font = true; // Default to standard font
+                spriteBackground[i][j] = cell_make(' ', current_bg_color, current_bg_color);
+                spriteBackgroundAttr[i][j] = 0; // Default to standard font
             }
         }
     }
@@ -221,14 +418,10 @@ void restoreBackground(int x, int y) {
             int row = y + i;
             int col = x + j;
             if (row < SCREEN_HEIGHT && col < SCREEN_WIDTH) {
-                ScreenCell cell = spriteBackground[i][j];
-                drawPixel(col, row, cell.bgcolor); // Restore the background color
-                if (cell.character != ' ') {
-                    if (cell.is_standard_font) {
-                        drawChar((col / CHAR_WIDTH) * CHAR_WIDTH, (row / CHAR_HEIGHT) * CHAR_HEIGHT, cell.character, cell.color, cell.bgcolor, 1);
-                    } else {
-                        drawCharBig((col / CHAR_WIDTH) * CHAR_WIDTH, (row / CHAR_HEIGHT) * CHAR_HEIGHT, cell.character, cell.color, cell.bgcolor);
-                    }
+                Cell cell = spriteBackground[i][j];
+                drawPixel(col, row, cell_bg(cell)); // Restore the background color
+                if (cell_char(cell) != ' ') {
+                    blit_cell((col / cell_width) * cell_width, (row / cell_height) * cell_height, cell, spriteBackgroundAttr[i][j]);
                 }
             }
         }
@@ -277,10 +470,11 @@ void move_sprite(int start_x, int start_y, int end_x, int end_y, int delay_ms) {
 
 // UART initialization
 void init_uart() {
-    uart_init(uart0, 115200);
+    uart_init(uart0, SERIAL_DEFAULT_BAUD);
     gpio_set_function(0, GPIO_FUNC_UART);
     gpio_set_function(1, GPIO_FUNC_UART);
-    stdio_uart_init_full(uart0, 115200, 0, 1);
+    stdio_uart_init_full(uart0, SERIAL_DEFAULT_BAUD, 0, 1);
+    serial_rx_init();
     printf("UART Initialized.\n");
 }
 
@@ -288,262 +482,975 @@ void init_uart() {
 void init_console() {
     cursor_row = 0;
     cursor_col = 0;
-    memset(screen_buffer, ' ', sizeof(screen_buffer));
+    cell_fill(&vc_cells[0][0], current_cell(' '), VC_ROWS * MAX_COLS);
+    memset(vc_attr, 0, sizeof(vc_attr));
     fillRect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, current_bg_color);
 }
 
-void scroll_standard_font() {
-    for (int y = 1; y < ROWS; y++) {
-        for (int x = 0; x < COLS; x++) {
-            screen_buffer[y - 1][x] = screen_buffer[y][x];
-            if (screen_buffer[y - 1][x].is_standard_font) {
-                drawChar(x * CHAR_WIDTH, (y - 1) * CHAR_HEIGHT, screen_buffer[y - 1][x].character, screen_buffer[y - 1][x].color, current_bg_color, 1);
-            } else {
-                drawCharBig(x * CHAR_WIDTH, (y - 1) * CHAR_HEIGHT, screen_buffer[y - 1][x].character, screen_buffer[y - 1][x].color, current_bg_color);
-            }
+// Shift the whole console up a row and redraw it in one font
+static void scroll_font(uint8_t attr) {
+    memmove(screen_buffer[0], screen_buffer[1], (console_rows - 1) * sizeof(screen_buffer[0]));
+    memmove(screen_attr[0], screen_attr[1], (console_rows - 1) * sizeof(screen_attr[0]));
+    cell_fill(screen_buffer[console_rows - 1], current_cell(' '), console_cols);
+    memset(screen_attr[console_rows - 1], attr, console_cols);
+    for (int y = 0; y < console_rows; y++) {
+        for (int x = 0; x < console_cols; x++) {
+            Cell cell = cell_with_bg(screen_buffer[y][x], current_bg_color);
+            blit_cell(x * cell_width, y * cell_height, cell, screen_attr[y][x]);
         }
     }
-    for (int x = 0; x < COLS; x++) {
-        screen_buffer[ROWS - 1][x].character = ' ';
-        screen_buffer[ROWS - 1][x].color = current_text_color;
-        screen_buffer[ROWS - 1][x].bgcolor = current_bg_color;
-        screen_buffer[ROWS - 1][x].is_standard_font = true; // Ensure the last row is using the standard font
-        drawChar(x * CHAR_WIDTH, (ROWS - 1) * CHAR_HEIGHT, ' ', current_text_color, current_bg_color, 1);
-    }
+}
+
+void scroll_standard_font() {
+    scroll_font(0); // Ensure the last row is using the standard font
 }
 
 void scroll_brl4_font() {
-    int brl4_char_height = 16;
-    int brl4_rows = SCREEN_HEIGHT / brl4_char_height;
-
-    for (int y = 1; y < brl4_rows; y++) {
-        for (int x = 0; x < COLS; x++) {
-            screen_buffer[y - 1][x] = screen_buffer[y][x];
-            if (screen_buffer[y - 1][x].is_standard_font) {
-                drawChar(x * CHAR_WIDTH, (y - 1) * CHAR_HEIGHT, screen_buffer[y - 1][x].character, screen_buffer[y - 1][x].color, current_bg_color, 1);
-            } else {
-                drawCharBig(x * CHAR_WIDTH, (y - 1) * brl4_char_height, screen_buffer[y - 1][x].character, screen_buffer[y - 1][x].color, current_bg_color);
+    scroll_font(ATTR_BIG_FONT); // Ensure the last row is using the BRL4 font
+}
+
+// Console output is batched: update_console only changes screen_buffer and
+// marks the cells that changed, and console_flush draws them once per frame
+// (or after CONSOLE_FLUSH_BYTES characters), so cells overwritten within a
+// frame are only drawn once. Scrolling up is batched too: the marks move
+// with the rows and the framebuffer is block-moved once, by the total, at
+// the flush, so lines that scroll through within a frame are never drawn.
+// Anything that moves or paints over console pixels flushes first to keep
+// the drawing order.
+#define CONSOLE_FLUSH_BYTES 1024
+
+bool console_batched = true;
+static uint8_t console_dirty[MAX_ROWS][(MAX_COLS + 7) / 8];
+static int console_pending = 0;             // characters since the last flush
+static bool console_has_dirty = false;
+static uint32_t console_arrival_us;         // arrival of the oldest undrawn character
+static uint32_t console_flush_frame;
+static uint32_t console_chars = 0, console_cells_drawn = 0, console_flushes = 0;
+
+// Scroll of rows pending_top..pending_bottom not yet applied to the pixels
+static int pending_scroll = 0;
+static int pending_top, pending_bottom;
+static char pending_fill;
+
+// Output to a console that is not on the screen only changes its cells
+static inline bool console_shown() {
+    return vc_active == vc_shown;
+}
+
+static inline void draw_cell(int row, int col) {
+    blit_cell(col * cell_width, row * cell_height, screen_buffer[row][col], screen_attr[row][col]);
+}
+
+void console_flush() {
+    vga_overlay_hide();
+    console_pending = 0;
+    if (!console_has_dirty) return;
+    console_has_dirty = false;
+    console_flushes++;
+    console_flush_frame = vga_frame_count;
+    if (pending_scroll > 0) {
+        int kept = pending_bottom - pending_top + 1 - pending_scroll;
+        vga_move_rows(pending_top * cell_height, (pending_top + pending_scroll) * cell_height, kept * cell_height);
+        vga_fill_rows((pending_bottom - pending_scroll + 1) * cell_height, pending_scroll * cell_height, pending_fill);
+        pending_scroll = 0;
+    }
+    for (int row = 0; row < console_rows; row++) {
+        uint8_t *bits = console_dirty[row];
+        for (int byte = 0; byte < (console_cols + 7) / 8; byte++) {
+            if (bits[byte] == 0) continue;
+            for (int bit = 0; bit < 8; bit++) {
+                if (bits[byte] & (1 << bit)) {
+                    draw_cell(row, byte * 8 + bit);
+                    console_cells_drawn++;
+                }
             }
+            bits[byte] = 0;
         }
     }
+}
 
-    // Clear the last row to prevent garbling
-    for (int x = 0; x < COLS; x++) {
-        screen_buffer[brl4_rows - 1][x].character = ' ';
-        screen_buffer[brl4_rows - 1][x].color = current_text_color;
-        screen_buffer[brl4_rows - 1][x].bgcolor = current_bg_color;
-        screen_buffer[brl4_rows - 1][x].is_standard_font = false; // Ensure the last row is using the BRL4 font
-        drawCharBig(x * CHAR_WIDTH, (brl4_rows - 1) * brl4_char_height, ' ', current_text_color, current_bg_color);
+// Write one cell in the current colors and font, marking it only if that
+// changes it
+static void put_cell(int row, int col, char c) {
+    Cell cell = current_cell(c);
+    uint8_t attr = text_attr();
+    if (screen_buffer[row][col] == cell && screen_attr[row][col] == attr) return;
+    screen_buffer[row][col] = cell;
+    screen_attr[row][col] = attr;
+    if (!console_shown()) return;
+    console_dirty[row][col >> 3] |= 1 << (col & 7);
+    console_has_dirty = true;
+}
+
+// Cells written through the memory port (offsets first..last into
+// vc_cells): those of the console on the screen are drawn at the next flush
+static void port_cells_written(uint32_t first, uint32_t last) {
+    int shown = vc_shown * console_rows * MAX_COLS;
+    int from = (int)(first / sizeof(Cell)) - shown, to = (int)(last / sizeof(Cell)) - shown;
+    if (from < 0) from = 0;
+    if (to >= console_rows * MAX_COLS) to = console_rows * MAX_COLS - 1;
+    for (int i = from; i <= to; i++) {
+        int row = i / MAX_COLS, col = i % MAX_COLS;
+        if (col >= console_cols) continue;
+        console_dirty[row][col >> 3] |= 1 << (col & 7);
+        console_has_dirty = true;
     }
 }
 
-// Optimized scroll screen function
-void scroll_screen() {
-    int scroll_height = use_standard_font ? CHAR_HEIGHT : 16; // Determine scroll height based on current font
+// Remember when the oldest undrawn console text arrived, for latency
+void console_note_arrival(uint32_t arrival_us) {
+    if (!console_has_dirty && console_pending == 0) console_arrival_us = arrival_us;
+}
 
-    // Scroll the screen buffer
-    for (int row = 1; row < ROWS; row++) {
-        for (int col = 0; col < COLS; col++) {
-            screen_buffer[row - 1][col] = screen_buffer[row][col];
-        }
+// Once per frame: draw what changed since the last flush
+void console_service() {
+    if (!console_has_dirty || vga_frame_count == console_flush_frame || vdp_active || crtc_active ||
+        scrollback_offset != 0) return;
+    latency_begin(console_arrival_us);
+    console_flush();
+    latency_end();
+}
+
+void console_report() {
+    printf("\nConsole: %s chars=%lu drawn=%lu flushes=%lu\n", console_batched ? "batched" : "immediate",
+           (unsigned long)console_chars, (unsigned long)console_cells_drawn, (unsigned long)console_flushes);
+    uint32_t hits, misses;
+    glyph_cache_counts(&hits, &misses);
+    printf("Glyph cache: %lu%% hits, hits=%lu misses=%lu, %d of %d entries\n",
+           (unsigned long)(hits + misses ? (uint64_t)hits * 100 / (hits + misses) : 0),
+           (unsigned long)hits, (unsigned long)misses, glyph_cache_used(), glyph_cache_limit());
+}
+
+// Blank n cells of a row in the current colors
+static inline void blank_cells(int row, int col, int n) {
+    cell_fill(&screen_buffer[row][col], current_cell(' '), n);
+    memset(&screen_attr[row][col], current_attr(), n);
+}
+
+// Redraw columns col0..col1 of one row from the screen buffer. Every cell
+// is blitted, blanks included, so each keeps its own background color.
+void redraw_cells(int row, int col0, int col1) {
+    if (!console_shown()) return;
+    console_flush();
+    for (int col = col0; col <= col1; col++) {
+        draw_cell(row, col);
     }
+}
 
-    // Clear the last row
-    for (int col = 0; col < COLS; col++) {
-        screen_buffer[ROWS - 1][col].character = ' ';
-        screen_buffer[ROWS - 1][col].color = current_text_color;
-        screen_buffer[ROWS - 1][col].bgcolor = current_bg_color;
-        screen_buffer[ROWS - 1][col].is_standard_font = use_standard_font;
+void redraw_rows(int top, int bottom) {
+    for (int row = top; row <= bottom; row++) {
+        redraw_cells(row, 0, console_cols - 1);
     }
+}
 
-    // Redraw the screen buffer
-    redraw_screen();
+// The top line of the console receiving output is about to scroll off the
+// screen: keep it in the scrollback ring. The ring is the history of the
+// console on the screen, so lines of one in the background are not kept.
+static void save_scrollback() {
+    if (!console_shown()) return;
+    scrollback_push(vc_cells[vc_active * console_rows], vc_attr[vc_active * console_rows]);
+}
+
+// History view: the screen shows the console as it was scrollback_offset
+// lines ago, drawn from packed rows with the cell blitter, each cell in
+// its own font and style as console_flush draws it. Scrolling the view
+// block-moves the rows that stay and draws only the ones that come in.
+static void draw_view_row(int row) {
+    int source = row - scrollback_offset;
+    const Cell *line = (source < 0) ? scrollback_line(-source) : vc_cells[vc_shown * console_rows + source];
+    const uint8_t *attr = (source < 0) ? scrollback_attr(-source) : vc_attr[vc_shown * console_rows + source];
+    for (int col = 0; col < console_cols; col++) {
+        blit_cell(col * cell_width, row * cell_height, line[col], attr[col]);
+    }
+}
+
+void show_scrollback(int offset) {
+    if (offset > scrollback_lines()) offset = scrollback_lines();
+    if (offset < 0) offset = 0;
+    int old = scrollback_offset;
+    if (offset == old) return;
+    scrollback_offset = offset;
+    if (offset == 0) {
+        redraw_screen();    // back to the live console
+        return;
+    }
+    if (old == 0) console_flush();
+    int delta = offset - old;   // > 0: further back, the view moves down
+    int first = 0, last = console_rows - 1;
+    if (old != 0 && delta > 0 && delta < console_rows) {
+        vga_move_rows(delta * cell_height, 0, (console_rows - delta) * cell_height);
+        last = delta - 1;
+    } else if (old != 0 && delta < 0 && -delta < console_rows) {
+        vga_move_rows(0, -delta * cell_height, (console_rows + delta) * cell_height);
+        first = console_rows + delta;
+    }
+    for (int row = first; row <= last; row++) {
+        draw_view_row(row);
+    }
+}
+
+// Move the cells of rows top..bottom by n (n no more than the band's
+// height), blanking the rows that come in
+static void move_cells_up(int top, int bottom, int n) {
+    int kept = bottom - top + 1 - n;
+    memmove(screen_buffer[top], screen_buffer[top + n], kept * sizeof(screen_buffer[0]));
+    memmove(screen_attr[top], screen_attr[top + n], kept * sizeof(screen_attr[0]));
+    for (int row = bottom - n + 1; row <= bottom; row++) {
+        blank_cells(row, 0, console_cols);
+    }
+}
+
+static void move_cells_down(int top, int bottom, int n) {
+    int kept = bottom - top + 1 - n;
+    memmove(screen_buffer[top + n], screen_buffer[top], kept * sizeof(screen_buffer[0]));
+    memmove(screen_attr[top + n], screen_attr[top], kept * sizeof(screen_attr[0]));
+    for (int row = top; row < top + n; row++) {
+        blank_cells(row, 0, console_cols);
+    }
+}
+
+// Move rows top..bottom up by n, blanking the rows that come in at the
+// bottom. The pixels move with one block copy of the band's framebuffer
+// lines, and only the vacated lines are cleared; nothing is redrawn.
+void scroll_region_up(int top, int bottom, int n) {
+    if (n > bottom - top + 1) n = bottom - top + 1;
+    if (!console_shown()) {
+        move_cells_up(top, bottom, n);
+        return;
+    }
+    if (!console_batched || (pending_scroll > 0 && (top != pending_top || bottom != pending_bottom ||
+                                                    current_bg_color != pending_fill))) {
+        console_flush();
+    }
+    int kept = bottom - top + 1 - n;
+    move_cells_up(top, bottom, n);
+    if (console_batched) {
+        memmove(console_dirty[top], console_dirty[top + n], kept * sizeof(console_dirty[0]));
+        memset(console_dirty[bottom - n + 1], 0, n * sizeof(console_dirty[0]));
+        pending_top = top;
+        pending_bottom = bottom;
+        pending_fill = current_bg_color;
+        pending_scroll += n;
+        if (pending_scroll > bottom - top + 1) pending_scroll = bottom - top + 1;
+        console_has_dirty = true;
+        return;
+    }
+    vga_move_rows(top * cell_height, (top + n) * cell_height, kept * cell_height);
+    vga_fill_rows((bottom - n + 1) * cell_height, n * cell_height, current_bg_color);
+}
+
+void scroll_region_down(int top, int bottom, int n) {
+    if (n > bottom - top + 1) n = bottom - top + 1;
+    int kept = bottom - top + 1 - n;
+    if (!console_shown()) {
+        move_cells_down(top, bottom, n);
+        return;
+    }
+    console_flush();
+    move_cells_down(top, bottom, n);
+    vga_move_rows((top + n) * cell_height, top * cell_height, kept * cell_height);
+    vga_fill_rows(top * cell_height, n * cell_height, current_bg_color);
+}
+
+// Restrict scrolling to rows first..last (0-based, inclusive) and home the
+// cursor. Returns false, changing nothing, for an empty or one-row region.
+bool set_scroll_region(int first, int last) {
+    if (first < 0) first = 0;
+    if (last >= console_rows) last = console_rows - 1;
+    if (first >= last) return false;
+    scroll_top = first;
+    scroll_bottom = last;
+    move_cursor(0, 0);
+    return true;
+}
+
+// Scroll the scroll region up by one line
+void scroll_screen() {
+    TRACE(TRACE_SCROLL, cursor_row);
+    scroll_region_up(scroll_top, scroll_bottom, 1);
 }
 
 // Function to clear the screen buffer and redraw the screen
 void clear_and_redraw_screen() {
     fillRect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, current_bg_color); // Clear the entire screen
-    for (int row = 0; row < ROWS; row++) {
-        for (int col = 0; col < COLS; col++) {
-            screen_buffer[row][col].character = ' ';
-            screen_buffer[row][col].color = current_text_color;
-            screen_buffer[row][col].bgcolor = current_bg_color;
-            screen_buffer[row][col].is_standard_font = use_standard_font;
-        }
-    }
+    cell_fill(&screen_buffer[0][0], current_cell(' '), console_rows * MAX_COLS);
+    memset(screen_attr, current_attr(), console_rows * MAX_COLS);
     redraw_screen();
 }
 
-// Function to redraw the screen buffer
-void redraw_screen() {
-    fillRect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, current_bg_color); // Clear the entire screen
-    for (int row = 0; row < ROWS; row++) {
-        for (int col = 0; col < COLS; col++) {
-            ScreenCell cell = screen_buffer[row][col];
-            if (cell.character != ' ') {
-                if (cell.is_standard_font) {
-                    drawChar(col * CHAR_WIDTH, row * CHAR_HEIGHT, cell.character, cell.color, cell.bgcolor, 1);
-                } else {
-                    drawCharBig(col * CHAR_WIDTH, row * CHAR_HEIGHT, cell.character, cell.color, cell.bgcolor);
-                }
-            }
+// Repaint the whole screen from the cells of the console shown, each cell
+// blitted over its own background
+void repaint_console() {
+    Cell (*cells)[MAX_COLS] = &vc_cells[vc_shown * console_rows];
+    uint8_t (*attr)[MAX_COLS] = &vc_attr[vc_shown * console_rows];
+    for (int row = 0; row < console_rows; row++) {
+        for (int col = 0; col < console_cols; col++) {
+            blit_cell(col * cell_width, row * cell_height, cells[row][col], attr[row][col]);
         }
     }
+    if (console_cols * cell_width < SCREEN_WIDTH) {
+        // The 4 pixels right of a 106-column console
+        fillRect(console_cols * cell_width, 0, SCREEN_WIDTH - console_cols * cell_width, SCREEN_HEIGHT, default_bg_color);
+    }
 }
 
-// Change font, clear the screen, and reset the cursor position
-void change_font(bool standard_font) {
-    use_standard_font = standard_font;
-    clear_screen(); // Clear the screen
-    cursor_row = 0; // Reset cursor position
-    cursor_col = 0;
+// Function to redraw the screen buffer
+void redraw_screen() {
+    memset(console_dirty, 0, sizeof(console_dirty));
+    console_has_dirty = false;
+    pending_scroll = 0;
+    repaint_console();
 }
 
 // Function to clear the screen
 void clear_screen() {
     // Clear the screen buffer and fill the screen with the background color
-    for (int row = 0; row < ROWS; row++) {
-        for (int col = 0; col < COLS; col++) {
-            screen_buffer[row][col].character = ' ';
-            screen_buffer[row][col].color = current_text_color;
-            screen_buffer[row][col].bgcolor = current_bg_color;
-            set_tile(row, col, ' ', current_text_color, current_bg_color, false);
-        }
+    Cell blank = current_cell(' ');
+    cell_fill(&screen_buffer[0][0], blank, console_rows * MAX_COLS);
+    memset(screen_attr, current_attr(), console_rows * MAX_COLS);
+    cell_fill(&tile_map[0][0], blank, ROWS * COLS);
+    memset(tile_sprites, 0, sizeof(tile_sprites));
+    if (console_shown()) {
+        // Cells and scrolls not yet drawn are wiped out with everything else;
+        // left pending, a later flush would paint them over the cleared screen
+        memset(console_dirty, 0, sizeof(console_dirty));
+        console_has_dirty = false;
+        console_pending = 0;
+        pending_scroll = 0;
+        vga_overlay_hide();
+        fillRect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, current_bg_color); // Ensure the entire screen is filled with the background color
     }
-    fillRect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, current_bg_color); // Ensure the entire screen is filled with the background color
     // Reset the cursor position
     cursor_row = 0;
     cursor_col = 0;
 }
 
-// Change background color
+// Swap color from for color to in both colors of n cells, matching what
+// vga_recolor does to their pixels
+static void recolor_cells(Cell *cells, int n, char from, char to) {
+    for (int i = 0; i < n; i++) {
+        Cell cell = cells[i];
+        if (cell_fg(cell) == from) cell = (cell & 0xf0ff) | (to << 8);
+        if (cell_bg(cell) == from) cell = cell_with_bg(cell, to);
+        cells[i] = cell;
+    }
+}
+
+// Change background color: the old background becomes the new one
+// everywhere, in one recolor pass over the framebuffer, whatever font or
+// graphics put the pixels there
 void change_background_color(char color) {
+    char old = default_bg_color;
     current_bg_color = color;
-    fillRect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, current_bg_color);
-    for (int row = 0; row < ROWS; row++) {
-        for (int col = 0; col < COLS; col++) {
-            screen_buffer[row][col].bgcolor = current_bg_color; // Ensure we update the screen buffer background color
-            set_tile(row, col, screen_buffer[row][col].character, screen_buffer[row][col].color, current_bg_color, false);
-            drawChar(col * CHAR_WIDTH, row * CHAR_HEIGHT, screen_buffer[row][col].character, screen_buffer[row][col].color, current_bg_color, 1);
-        }
-    }
+    default_bg_color = color;
+    if (old == color) return;
+    recolor_cells(&screen_buffer[0][0], console_rows * MAX_COLS, old, color);
+    recolor_cells(&tile_map[0][0], ROWS * COLS, old, color);
+    if (console_shown()) vga_recolor(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, old, color);
 }
 
 // Change text color
 void change_text_color(char color) {
     current_text_color = color;
+    default_text_color = color;
+}
+
+// Move down a line. On the last row of the scroll region the region
+// scrolls instead; below the region the cursor stops at the bottom. Only
+// a full-screen region scrolls lines off into the history: a fixed header
+// or footer, SU and deleted lines do not fill it.
+void line_feed() {
+    if (cursor_row == scroll_bottom) {
+        if (scroll_top == 0 && scroll_bottom == console_rows - 1) save_scrollback();
+        scroll_screen();
+    } else if (cursor_row < console_rows - 1) {
+        cursor_row++;
+    }
 }
 
 void update_cursor_and_scroll() {
     cursor_col = 0;
-    cursor_row++;
-    if (cursor_row >= ROWS) {
-        cursor_row = ROWS - 1;
-        scroll_screen();
+    line_feed();
+}
+
+// Text windows: up to MAX_WINDOWS rectangles of console cells, each with
+// its own cursor, colors, wrap and scroll. Text routed to a window (/WINDOW n
+// or CSI = n W) goes into the console's cells inside it, and a full window
+// scrolls by block-moving just its own rectangle of the framebuffer. While a
+// window has the output its colors are the current colors, so SGR sets them.
+#define MAX_WINDOWS 8
+
+typedef struct {
+    bool defined;
+    int left, top, width, height;   // in cells
+    int row, col;                   // cursor, relative to the window
+    char text_color, bg_color;
+    bool wrap;                      // otherwise text past the right edge is dropped
+} TextWindow;
+
+static TextWindow windows[MAX_WINDOWS];
+int window_active = -1;             // window receiving text, -1 for the console
+static char console_text_color, console_bg_color;  // kept while a window has the output
+
+// Bring the active window's copy of its colors up to date
+static void store_window_colors() {
+    if (window_active < 0) return;
+    windows[window_active].text_color = current_text_color;
+    windows[window_active].bg_color = current_bg_color;
+}
+
+// Send text to window id (0-based), or back to the console for -1
+void select_window(int id) {
+    if (id == window_active || id >= MAX_WINDOWS || (id >= 0 && !windows[id].defined)) return;
+    if (window_active < 0) {
+        console_text_color = current_text_color;
+        console_bg_color = current_bg_color;
+    } else {
+        store_window_colors();
+    }
+    window_active = id;
+    if (id < 0) {
+        current_text_color = console_text_color;
+        current_bg_color = console_bg_color;
+    } else {
+        current_text_color = windows[id].text_color;
+        current_bg_color = windows[id].bg_color;
     }
 }
 
-void update_console(char c) {
+static void blank_window_row(TextWindow *w, int row) {
+    cell_fill(&screen_buffer[w->top + row][w->left], cell_make(' ', w->text_color, w->bg_color), w->width);
+    memset(&screen_attr[w->top + row][w->left], current_attr(), w->width);
+}
+
+void clear_window(int id) {
+    TextWindow *w = &windows[id];
+    store_window_colors();
+    for (int row = 0; row < w->height; row++) {
+        blank_window_row(w, row);
+    }
+    if (console_shown()) {
+        console_flush();
+        fillRect(w->left * cell_width, w->top * cell_height, w->width * cell_width, w->height * cell_height, w->bg_color);
+    }
+    w->row = 0;
+    w->col = 0;
+}
+
+// Define window id over the given cells, clipped to the screen, in the
+// current colors. Returns false for a window with no cells.
+bool define_window(int id, int left, int top, int width, int height, bool wrap) {
+    if (id < 0 || id >= MAX_WINDOWS || left < 0 || top < 0 || left >= console_cols || top >= console_rows) return false;
+    if (width > console_cols - left) width = console_cols - left;
+    if (height > console_rows - top) height = console_rows - top;
+    if (width < 1 || height < 1) return false;
+    TextWindow *w = &windows[id];
+    w->defined = true;
+    w->left = left;
+    w->top = top;
+    w->width = width;
+    w->height = height;
+    w->wrap = wrap;
+    if (id != window_active) {
+        w->text_color = current_text_color;
+        w->bg_color = current_bg_color;
+    }
+    clear_window(id);
+    return true;
+}
+
+void delete_window(int id) {
+    if (id == window_active) select_window(-1);
+    windows[id].defined = false;
+}
+
+// Scroll a window's rows up by one: its cells move row by row, and on the
+// screen one block move of its rectangle plus a fill of the bottom row
+static void scroll_window(TextWindow *w) {
+    if (console_shown()) console_flush();
+    for (int row = w->top; row < w->top + w->height - 1; row++) {
+        memmove(&screen_buffer[row][w->left], &screen_buffer[row + 1][w->left], w->width * sizeof(Cell));
+        memmove(&screen_attr[row][w->left], &screen_attr[row + 1][w->left], w->width);
+    }
+    blank_window_row(w, w->height - 1);
+    if (!console_shown()) return;
+    short x = w->left * cell_width, y = w->top * cell_height, width = w->width * cell_width;
+    vga_move_rect(x, y, x, y + cell_height, width, (w->height - 1) * cell_height);
+    fillRect(x, y + (w->height - 1) * cell_height, width, cell_height, w->bg_color);
+}
+
+static void window_line_feed(TextWindow *w) {
+    w->col = 0;
+    if (w->row < w->height - 1) {
+        w->row++;
+    } else {
+        scroll_window(w);
+    }
+}
+
+// One character of text in the active window. Wrapping waits for the next
+// character, so filling the last column does not scroll a blank line in.
+static void window_write(char c) {
+    TextWindow *w = &windows[window_active];
+    store_window_colors();
     if (c == '\r' || c == '\n') {
-        cursor_col = 0;
-        cursor_row++;
-        if (cursor_row >= ROWS) {
-            cursor_row = ROWS - 1;
-            scroll_screen();
+        window_line_feed(w);
+    } else if (c == 8 || c == 127) {
+        if (w->col > 0) w->col--;
+        put_cell(w->top + w->row, w->left + w->col, ' ');
+    } else if (c >= 32 && c <= 126) {
+        if (w->col >= w->width) {
+            if (!w->wrap) return;
+            window_line_feed(w);
         }
+        put_cell(w->top + w->row, w->left + w->col, c);
+        w->col++;
+    }
+}
+
+void window_report() {
+    store_window_colors();
+    printf("\nWindows: output to %d\n", window_active + 1);
+    for (int i = 0; i < MAX_WINDOWS; i++) {
+        TextWindow *w = &windows[i];
+        if (!w->defined) continue;
+        printf("  %d: %dx%d at %d,%d cursor %d,%d%s\n", i + 1, w->width, w->height, w->left + 1, w->top + 1,
+               w->col + 1, w->row + 1, w->wrap ? "" : " nowrap");
+    }
+}
+
+void update_console(char c) {
+    if (window_active >= 0) {
+        window_write(c);
+    } else if (c == '\r' || c == '\n') {
+        cursor_col = 0;
+        line_feed();
     } else if (c == 8 || c == 127) { // Handle backspace
         if (cursor_col > 0) {
             cursor_col--;
         } else if (cursor_row > 0) {
             cursor_row--;
-            cursor_col = COLS - 1;
-        }
-        screen_buffer[cursor_row][cursor_col].character = ' ';
-        screen_buffer[cursor_row][cursor_col].color = current_text_color;
-        screen_buffer[cursor_row][cursor_col].bgcolor = current_bg_color;
-        if (use_standard_font) {
-            drawChar(cursor_col * CHAR_WIDTH, cursor_row * CHAR_HEIGHT, ' ', current_text_color, current_bg_color, 1);
-        } else {
-            drawCharBig(cursor_col * CHAR_WIDTH, cursor_row * 16, ' ', current_text_color, current_bg_color);
+            cursor_col = console_cols - 1;
         }
+        put_cell(cursor_row, cursor_col, ' ');
     } else if (c >= 32 && c <= 126) {
-        screen_buffer[cursor_row][cursor_col].character = c;
-        screen_buffer[cursor_row][cursor_col].color = current_text_color;
-        screen_buffer[cursor_row][cursor_col].bgcolor = current_bg_color;
-        screen_buffer[cursor_row][cursor_col].is_standard_font = use_standard_font; // Track font type
-        if (use_standard_font) {
-            drawChar(cursor_col * CHAR_WIDTH, cursor_row * CHAR_HEIGHT, c, current_text_color, current_bg_color, 1);
-        } else {
-            drawCharBig(cursor_col * CHAR_WIDTH, cursor_row * 16, c, current_text_color, current_bg_color);
-        }
+        put_cell(cursor_row, cursor_col, c);
         cursor_col++;
-        if (cursor_col >= COLS) {
+        if (cursor_col >= console_cols) {
             cursor_col = 0;
-            cursor_row++;
-            if (cursor_row >= ROWS) {
-                cursor_row = ROWS - 1;
-                scroll_screen();
-            }
+            line_feed();
         }
     }
+    console_chars++;
+    if (!console_batched || ++console_pending >= CONSOLE_FLUSH_BYTES) {
+        console_flush();
+    }
 }
 
 void move_cursor(int row, int col) {
     cursor_row = row;
     cursor_col = col;
-    if (cursor_row >= ROWS) cursor_row = ROWS - 1;
-    if (cursor_col >= COLS) cursor_col = COLS - 1;
-}
-
-void set_text_attributes(const char *seq) {
-    int attribute_code = 0;
-    // Manually parse the sequence to extract the attribute code
-    sscanf(seq, "%d", &attribute_code);
-
-    switch (attribute_code) {
-        case 30: current_text_color = BLACK; break;
-        case 31: current_text_color = RED; break;
-        case 32: current_text_color = DARK_GREEN; break;
-        case 33: current_text_color = YELLOW; break;
-        case 34: current_text_color = DARK_BLUE; break;
-        case 35: current_text_color = MAGENTA; break;
-        case 36: current_text_color = CYAN; break;
-        case 37: current_text_color = WHITE; break;
-        default: current_text_color = WHITE; break; // Default to white if the attribute code is invalid
-    }
-}
-
-void handle_ansi_escape(const char *seq) {
-    if (seq[0] == '[') {
-        int row, col;
-        switch (seq[1]) {
-            case 'H': // Cursor position
-                sscanf(seq + 2, "%d;%d", &row, &col);
-                move_cursor(row - 1, col - 1);
-                break;
-            case '2': // Clear screen
-                if (seq[2] == 'J') {
-                    clear_screen();
-                }
-                break;
-            case '3': // Set text attributes (color)
-                set_text_attributes(seq + 1); // Adjusted to start from the correct position
-                break;
-            case '9': // Set text attributes (color)
-                set_text_attributes(seq + 1); // Adjusted to start from the correct position
-                break;
-            default:
-                break;
+    if (cursor_row < 0) cursor_row = 0;
+    if (cursor_col < 0) cursor_col = 0;
+    if (cursor_row >= console_rows) cursor_row = console_rows - 1;
+    if (cursor_col >= console_cols) cursor_col = console_cols - 1;
+}
+
+// Blank columns col0..col1 of one row in the current colors
+void erase_cells(int row, int col0, int col1) {
+    console_flush();
+    if (col1 >= console_cols) col1 = console_cols - 1;
+    if (col0 > col1) return;
+    blank_cells(row, col0, col1 - col0 + 1);
+    if (!console_shown()) return;
+    fillRect(col0 * cell_width, row * cell_height, (col1 - col0 + 1) * cell_width, cell_height, current_bg_color);
+}
+
+// ICH and DCH: shift the rest of the cursor's line right or left by n
+void insert_cells(int n) {
+    Cell *line = screen_buffer[cursor_row];
+    uint8_t *attr = screen_attr[cursor_row];
+    if (n > console_cols - cursor_col) n = console_cols - cursor_col;
+    memmove(&line[cursor_col + n], &line[cursor_col], (console_cols - cursor_col - n) * sizeof(Cell));
+    memmove(&attr[cursor_col + n], &attr[cursor_col], console_cols - cursor_col - n);
+    blank_cells(cursor_row, cursor_col, n);
+    redraw_cells(cursor_row, cursor_col, console_cols - 1);
+}
+
+void delete_cells(int n) {
+    Cell *line = screen_buffer[cursor_row];
+    uint8_t *attr = screen_attr[cursor_row];
+    if (n > console_cols - cursor_col) n = console_cols - cursor_col;
+    memmove(&line[cursor_col], &line[cursor_col + n], (console_cols - cursor_col - n) * sizeof(Cell));
+    memmove(&attr[cursor_col], &attr[cursor_col + n], console_cols - cursor_col - n);
+    blank_cells(cursor_row, console_cols - n, n);
+    redraw_cells(cursor_row, cursor_col, console_cols - 1);
+}
+
+// ANSI colors 0-7 and their bright variants
+static const char ansi_colors[8] = { BLACK, RED, DARK_GREEN, YELLOW, DARK_BLUE, MAGENTA, CYAN, WHITE };
+static const char ansi_bright_colors[8] = { DARK_GREEN, DARK_ORANGE, GREEN, YELLOW, BLUE, PINK, LIGHT_BLUE, WHITE };
+
+// SGR: every parameter in order, no parameters meaning reset
+void set_text_attributes(const AnsiSequence *seq) {
+    int count = seq->nparams ? seq->nparams : 1;
+    for (int i = 0; i < count; i++) {
+        int code = (i < seq->nparams) ? seq->params[i] : 0;
+        if (code == 0) {
+            current_text_color = default_text_color;
+            current_bg_color = default_bg_color;
+            current_style = 0;
+        } else if (code == 1) {
+            current_style |= VGA_STYLE_BOLD;
+        } else if (code == 4) {
+            current_style |= VGA_STYLE_UNDERLINE;
+        } else if (code == 7) {
+            current_style |= VGA_STYLE_REVERSE;
+        } else if (code == 22) {
+            current_style &= ~VGA_STYLE_BOLD;
+        } else if (code == 24) {
+            current_style &= ~VGA_STYLE_UNDERLINE;
+        } else if (code == 27) {
+            current_style &= ~VGA_STYLE_REVERSE;
+        } else if (code >= 30 && code <= 37) {
+            current_text_color = ansi_colors[code - 30];
+        } else if (code == 39) {
+            current_text_color = default_text_color;
+        } else if (code >= 40 && code <= 47) {
+            current_bg_color = ansi_colors[code - 40];
+        } else if (code == 49) {
+            current_bg_color = default_bg_color;
+        } else if (code >= 90 && code <= 97) {
+            current_text_color = ansi_bright_colors[code - 90];
+        } else if (code >= 100 && code <= 107) {
+            current_bg_color = ansi_bright_colors[code - 100];
+        } else if (code == 38 || code == 48) {
+            // 256-color and RGB forms are skipped with their arguments
+            if (i + 1 < seq->nparams) {
+                i += (seq->params[i + 1] == 5) ? 2 : (seq->params[i + 1] == 2) ? 4 : 1;
+            }
         }
     }
 }
 
+// Saved by DECSC (ESC 7) and CSI s
+static int saved_row, saved_col;
+static char saved_text_color = GREEN, saved_bg_color = BLACK;
+static uint8_t saved_style = 0;
+
+void save_cursor() {
+    saved_row = cursor_row;
+    saved_col = cursor_col;
+    saved_text_color = current_text_color;
+    saved_bg_color = current_bg_color;
+    saved_style = current_style;
+}
+
+void restore_cursor() {
+    move_cursor(saved_row, saved_col);
+    current_text_color = saved_text_color;
+    current_bg_color = saved_bg_color;
+    current_style = saved_style;
+}
+
+void reset_terminal() {
+    current_text_color = default_text_color;
+    current_bg_color = default_bg_color;
+    current_style = 0;
+    scroll_top = 0;
+    scroll_bottom = console_rows - 1;
+    clear_screen();
+}
+
+// The terminal state of the consoles not receiving output; the active one's
+// lives in the globals. Switching consoles copies this struct and swaps the
+// cell plane pointers, whatever is on them.
+typedef struct {
+    int cursor_row, cursor_col;
+    char text_color, bg_color;
+    uint8_t style;
+    char default_text_color, default_bg_color;
+    int scroll_top, scroll_bottom;
+    int saved_row, saved_col;
+    char saved_text_color, saved_bg_color;
+    uint8_t saved_style;
+} ConsoleState;
+
+static ConsoleState vc_state[VC_COUNT];
+
+static void save_console_state(ConsoleState *vc) {
+    vc->cursor_row = cursor_row;
+    vc->cursor_col = cursor_col;
+    vc->text_color = current_text_color;
+    vc->bg_color = current_bg_color;
+    vc->style = current_style;
+    vc->default_text_color = default_text_color;
+    vc->default_bg_color = default_bg_color;
+    vc->scroll_top = scroll_top;
+    vc->scroll_bottom = scroll_bottom;
+    vc->saved_row = saved_row;
+    vc->saved_col = saved_col;
+    vc->saved_text_color = saved_text_color;
+    vc->saved_bg_color = saved_bg_color;
+    vc->saved_style = saved_style;
+}
+
+static void load_console_state(const ConsoleState *vc) {
+    cursor_row = vc->cursor_row;
+    cursor_col = vc->cursor_col;
+    current_text_color = vc->text_color;
+    current_bg_color = vc->bg_color;
+    current_style = vc->style;
+    default_text_color = vc->default_text_color;
+    default_bg_color = vc->default_bg_color;
+    scroll_top = vc->scroll_top;
+    scroll_bottom = vc->scroll_bottom;
+    saved_row = vc->saved_row;
+    saved_col = vc->saved_col;
+    saved_text_color = vc->saved_text_color;
+    saved_bg_color = vc->saved_bg_color;
+    saved_style = vc->saved_style;
+}
+
+// Every console starts as a copy of the first one's state
+void init_virtual_consoles() {
+    for (int i = 0; i < VC_COUNT; i++) {
+        save_console_state(&vc_state[i]);
+    }
+}
+
+// Send output to console n (0-based) without changing what is shown
+void select_console(int n) {
+    if (n < 0 || n >= vc_count || n == vc_active) return;
+    select_window(-1);
+    if (console_shown()) console_flush();
+    save_console_state(&vc_state[vc_active]);
+    vc_active = n;
+    load_console_state(&vc_state[n]);
+    screen_buffer = &vc_cells[n * console_rows];
+    screen_attr = &vc_attr[n * console_rows];
+}
+
+// Put console n on the screen; it also receives output from now on
+void show_console(int n) {
+    if (n < 0 || n >= vc_count) return;
+    select_console(n);
+    if (n == vc_shown) return;
+    vc_shown = n;
+    scrollback_offset = 0;
+    redraw_screen();
+}
+
+// Change font, which sets the console geometry. A new cell size clears
+// every console and lays the pool of rows out again, so all consoles go
+// back to their first row and the windows and history are dropped.
+void change_font(bool standard_font) {
+    use_standard_font = standard_font;
+    int width = standard_font ? 6 : CHAR_WIDTH, height = standard_font ? 8 : CHAR_HEIGHT;
+    if (width != cell_width || height != cell_height) {
+        select_window(-1);
+        for (int i = 0; i < MAX_WINDOWS; i++) windows[i].defined = false;
+        console_flush();
+        memset(console_dirty, 0, sizeof(console_dirty));
+        console_has_dirty = false;
+        pending_scroll = 0;
+        cell_width = width;
+        cell_height = height;
+        console_cols = SCREEN_WIDTH / width;
+        console_rows = SCREEN_HEIGHT / height;
+        vc_count = VC_ROWS / console_rows;
+        vc_active = vc_shown = 0;
+        screen_buffer = vc_cells;
+        screen_attr = vc_attr;
+        cell_fill(&vc_cells[0][0], current_cell(' '), VC_ROWS * MAX_COLS);
+        memset(vc_attr, current_attr(), sizeof(vc_attr));
+        scroll_top = 0;
+        scroll_bottom = console_rows - 1;
+        cursor_row = cursor_col = 0;
+        for (int i = 0; i < VC_COUNT; i++) {
+            save_console_state(&vc_state[i]);
+        }
+        scrollback_offset = 0;
+        scrollback_clear();
+    }
+    clear_screen(); // Clear the screen
+    cursor_row = 0; // Reset cursor position
+    cursor_col = 0;
+}
+
+// Text cursor: an XOR overlay on the cursor's cell, toggled from the frame
+// count. Anything that draws hides it first (console_flush, every queued
+// unit, memory port writes), and cursor_service puts it back on a later
+// frame, so the drawing paths never test for it.
+#define CURSOR_OFF       0
+#define CURSOR_BLOCK     1
+#define CURSOR_UNDERLINE 2
+
+int cursor_shape = CURSOR_BLOCK;
+int cursor_blink_frames = 30;       // frames per on or off phase, 0 for steady
+static bool cursor_on = true;
+static uint32_t cursor_phase_frame;
+
+// The cell the cursor marks: the cursor of the console shown, or of the
+// window receiving its text
+static void cursor_cell(int *row, int *col) {
+    if (!console_shown()) {
+        *row = vc_state[vc_shown].cursor_row;
+        *col = vc_state[vc_shown].cursor_col;
+    } else if (window_active >= 0) {
+        TextWindow *w = &windows[window_active];
+        *row = w->top + w->row;
+        *col = w->left + (w->col < w->width ? w->col : w->width - 1);
+    } else {
+        *row = cursor_row;
+        *col = cursor_col;
+    }
+}
+
+void cursor_service() {
+    if (cursor_shape == CURSOR_OFF || vdp_active || crtc_active || scrollback_offset != 0) {
+        vga_overlay_hide();
+        return;
+    }
+    if (cursor_blink_frames == 0) {
+        cursor_on = true;
+    } else if (vga_frame_count - cursor_phase_frame >= (uint32_t)cursor_blink_frames) {
+        cursor_on = !cursor_on;
+        cursor_phase_frame = vga_frame_count;
+    }
+    if (!cursor_on) {
+        vga_overlay_hide();
+        return;
+    }
+    int row, col;
+    cursor_cell(&row, &col);
+    int height = (cursor_shape == CURSOR_UNDERLINE) ? cell_height / 8 : cell_height;
+    vga_overlay_show(col * cell_width, row * cell_height + cell_height - height, cell_width, height);
+}
+
+// Two-byte ESC sequences
+void handle_esc_sequence(const AnsiSequence *seq) {
+    if (seq->intermediate != 0) return;     // character set selection and the like
+    switch (seq->final) {
+        case '7': save_cursor(); break;
+        case '8': restore_cursor(); break;
+        case 'D': line_feed(); break;                               // IND
+        case 'E': cursor_col = 0; line_feed(); break;               // NEL
+        case 'M':                                                   // RI
+            if (cursor_row == scroll_top) {
+                scroll_region_down(scroll_top, scroll_bottom, 1);
+            } else if (cursor_row > 0) {
+                cursor_row--;
+            }
+            break;
+        case 'c': reset_terminal(); break;                          // RIS
+        default: break;
+    }
+}
+
+void handle_ansi_escape(const AnsiSequence *seq) {
+    if (seq->type != '[') {
+        handle_esc_sequence(seq);
+        return;
+    }
+    // CSI = n V: send output to virtual console n (1-based)
+    if (seq->private_mark == '=' && seq->final == 'V' && seq->intermediate == 0) {
+        select_console(ansi_param(seq, 0, 1) - 1);
+        return;
+    }
+    // CSI = n W: send text to window n, or to the console for 0
+    if (seq->private_mark == '=' && seq->final == 'W' && seq->intermediate == 0) {
+        select_window(ansi_param(seq, 0, 0) - 1);
+        return;
+    }
+    // Private modes (CSI ? ...) such as cursor visibility are not emulated
+    if (seq->private_mark != 0 || seq->intermediate != 0) return;
+
+    int n = ansi_param(seq, 0, 1);
+    // Cursor movement stops at the scroll region's margins when inside it
+    int top = (cursor_row >= scroll_top) ? scroll_top : 0;
+    int bottom = (cursor_row <= scroll_bottom) ? scroll_bottom : console_rows - 1;
+    char response[32];
+
+    switch (seq->final) {
+        case 'A': move_cursor(cursor_row - n < top ? top : cursor_row - n, cursor_col); break;          // CUU
+        case 'B': move_cursor(cursor_row + n > bottom ? bottom : cursor_row + n, cursor_col); break;    // CUD
+        case 'C': move_cursor(cursor_row, cursor_col + n); break;                                       // CUF
+        case 'D': move_cursor(cursor_row, cursor_col - n); break;                                       // CUB
+        case 'E': move_cursor(cursor_row + n > bottom ? bottom : cursor_row + n, 0); break;            // CNL
+        case 'F': move_cursor(cursor_row - n < top ? top : cursor_row - n, 0); break;                  // CPL
+        case 'G': case '`': move_cursor(cursor_row, n - 1); break;                                      // CHA
+        case 'd': move_cursor(n - 1, cursor_col); break;                                                // VPA
+        case 'H': case 'f':                                                                             // CUP
+            move_cursor(n - 1, ansi_param(seq, 1, 1) - 1);
+            break;
+        case 'J':                                                                                       // ED
+            switch (ansi_param(seq, 0, 0)) {
+                case 0:
+                    erase_cells(cursor_row, cursor_col, console_cols - 1);
+                    for (int row = cursor_row + 1; row < console_rows; row++) erase_cells(row, 0, console_cols - 1);
+                    break;
+                case 1:
+                    for (int row = 0; row < cursor_row; row++) erase_cells(row, 0, console_cols - 1);
+                    erase_cells(cursor_row, 0, cursor_col);
+                    break;
+                default:
+                    clear_screen();     // also homes the cursor, as ANSI.SYS does
+                    break;
+            }
+            break;
+        case 'K':                                                                                       // EL
+            switch (ansi_param(seq, 0, 0)) {
+                case 0: erase_cells(cursor_row, cursor_col, console_cols - 1); break;
+                case 1: erase_cells(cursor_row, 0, cursor_col); break;
+                default: erase_cells(cursor_row, 0, console_cols - 1); break;
+            }
+            break;
+        case 'X': erase_cells(cursor_row, cursor_col, cursor_col + n - 1); break;                       // ECH
+        case '@': insert_cells(n); break;                                                               // ICH
+        case 'P': delete_cells(n); break;                                                               // DCH
+        case 'L':                                                                                       // IL
+            if (cursor_row >= scroll_top && cursor_row <= scroll_bottom) {
+                scroll_region_down(cursor_row, scroll_bottom, n);
+                cursor_col = 0;
+            }
+            break;
+        case 'M':                                                                                       // DL
+            if (cursor_row >= scroll_top && cursor_row <= scroll_bottom) {
+                scroll_region_up(cursor_row, scroll_bottom, n);
+                cursor_col = 0;
+            }
+            break;
+        case 'S': scroll_region_up(scroll_top, scroll_bottom, n); break;                                // SU
+        case 'T': scroll_region_down(scroll_top, scroll_bottom, n); break;                              // SD
+        case 'm': set_text_attributes(seq); break;                                                      // SGR
+        case 'r':                                                                                       // DECSTBM
+            set_scroll_region(ansi_param(seq, 0, 1) - 1, ansi_param(seq, 1, console_rows) - 1);
+            break;
+        case 's': save_cursor(); break;
+        case 'u': restore_cursor(); break;
+        case 'n':                                                                                       // DSR
+            if (n == 5) {
+                reply("\033[0n");
+            } else if (n == 6) {
+                snprintf(response, sizeof(response), "\033[%d;%dR", cursor_row + 1, cursor_col + 1);
+                reply(response);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
 void scroll_map(int scroll_amount, int delay_ms) {
     for (int i = 0; i < scroll_amount; i++) {
         // Shift the tile map to the left
         for (int row = 0; row < ROWS; row++) {
-            for (int col = 0; col < COLS - 1; col++) {
-                tile_map[row][col] = tile_map[row][col + 1];
+            memmove(&tile_map[row][0], &tile_map[row][1], (COLS - 1) * sizeof(Cell));
+            uint32_t *sprites = tile_sprites[row];
+            for (int w = 0; w < (COLS + 31) / 32; w++) {
+                uint32_t carry = (w + 1 < (COLS + 31) / 32) ? sprites[w + 1] << 31 : 0;
+                sprites[w] = (sprites[w] >> 1) | carry;
             }
             // Set the rightmost column to empty tiles
             set_tile(row, COLS - 1, ' ', current_text_color, current_bg_color, false);
@@ -568,156 +1475,649 @@ void drawPETSCIIString(int x, int y, const char* str, char color) {
     }
 }
 
-void handle_serial_input() {
-    static int index = 0;
-    static char c;
-    static char command[BUFFER_SIZE];
-    bool command_mode = false;
-    bool ansi_mode = false;
-    char ansi_seq[BUFFER_SIZE];
-    int ansi_index = 0;
-
-    while (index < BUFFER_SIZE - 1) {
-        if (uart_is_readable(uart0)) {
-            c = uart_getc(uart0);
-            // Remove the debug print statement
-            // printf("Received character: %c\n", c);
-
-            if (ansi_mode) {
-                if (c == 'm' || c == 'H' || c == 'J') {
-                    ansi_seq[ansi_index++] = c;
-                    ansi_seq[ansi_index] = '\0';
-                    handle_ansi_escape(ansi_seq);
-                    ansi_mode = false;
-                    ansi_index = 0;
-                } else {
-                    ansi_seq[ansi_index++] = c;
-                }
-            } else if (command_mode) {
-                uart_putc(uart0, c);
-                command[index++] = c;
-
-                if (c == '\r' || c == '\n' || index == BUFFER_SIZE - 1) {
-                    command[index] = '\0';
-                    command_mode = false;
-
-                    if (strncmp(command, "/TEXT ", 6) == 0 || strncmp(command, "TEXT ", 5) == 0) {
-                        char color_code[20];
-                        sscanf(command + 6, "%s", color_code);
-                        change_text_color(parse_color_code(color_code));
-                    } else if (strncmp(command, "/BACK ", 6) == 0 || strncmp(command, "BACK ", 5) == 0) {
-                        char color_code[20];
-                        sscanf(command + 6, "%s", color_code);
-                        change_background_color(parse_color_code(color_code));
-                    } else if (strncmp(command, "/CLS", 4) == 0) {
-                        clear_screen();
-                        //uart_puts(uart0, "\nScreen cleared.\n"); // Optional feedback
-                    } else if (strncmp(command, "/LINE ", 6) == 0) {
-                        int x1, y1, x2, y2;
-                        char color_code[20];
-                        sscanf(command + 6, "%d %d %d %d %s", &x1, &y1, &x2, &y2, color_code);
-                        drawLine(x1, y1, x2, y2, parse_color_code(color_code));
-                    } else if (strncmp(command, "/RECT ", 6) == 0) {
-                        int x, y, width, height;
-                        char color_code[20];
-                        sscanf(command + 6, "%d %d %d %d %s", &x, &y, &width, &height, color_code);
-                        drawRect(x, y, width, height, parse_color_code(color_code));
-                    } else if (strncmp(command, "/FILLRECT ", 10) == 0) {
-                        int x, y, width, height;
-                        char color_code[20];
-                        sscanf(command + 10, "%d %d %d %d %s", &x, &y, &width, &height, color_code);
-                        fillRect(x, y, width, height, parse_color_code(color_code));
-                    } else if (strncmp(command, "/CIRCLE ", 8) == 0) {
-                        int x, y, radius;
-                        char color_code[20];
-                        sscanf(command + 8, "%d %d %d %s", &x, &y, &radius, color_code);
-                        drawCircle(x, y, radius, parse_color_code(color_code));
-                    } else if (strncmp(command, "/FILLCIRCLE ", 12) == 0) {
-                        int x, y, radius;
-                        char color_code[20];
-                        sscanf(command + 12, "%d %d %d %s", &x, &y, &radius, color_code);
-                        fillCircle(x, y, radius, parse_color_code(color_code));
-                    } else if (strncmp(command, "/ROUNDRECT ", 11) == 0) {
-                        int x, y, width, height, radius;
-                        char color_code[20];
-                        sscanf(command + 11, "%d %d %d %d %d %s", &x, &y, &width, &height, &radius, color_code);
-                        drawRoundRect(x, y, width, height, radius, parse_color_code(color_code));
-                    } else if (strncmp(command, "/FILLROUNDRECT ", 15) == 0) {
-                        int x, y, width, height, radius;
-                        char color_code[20];
-                        sscanf(command + 15, "%d %d %d %d %d %s", &x, &y, &width, &height, &radius, color_code);
-                        fillRoundRect(x, y, width, height, radius, parse_color_code(color_code));
-                    } else if (strncmp(command, "/FONT ", 6) == 0 || strncmp(command, "FONT ", 5) == 0) {
-                        if (strstr(command, "STANDARD") != NULL) {
-                            change_font(true);
-                            uart_puts(uart0, "\nFont set to Standard 5x7.\n");
-                        } else if (strstr(command, "BRL4") != NULL) {
-                            change_font(false);
-                            uart_puts(uart0, "\nFont set to BRL4.\n");
-                        } else {
-                            uart_puts(uart0, "\nInvalid font type.\n");
-                        }
-                    } else if (strncmp(command, "/SMILEY", 7) == 0 || strncmp(command, "SMILEY", 6) == 0) {
-                        int x = 50, y = 50;
-                        saveBackground(x, y); // Save initial background state
-                        for (int i = 0; i < 50; i++) {
-                            clearSprite(x, y, 8, 8); // Clear previous sprite
-                            x += 2; // Update position
-                            y += 2;
-                            saveBackground(x, y); // Save background at new position
-                            drawSprite(x, y, smiley, 8, 8, YELLOW); // Draw new sprite
-                            sleep_ms(100); // Delay for a short period
-                        }
-                    } else if (strncmp(command, "/MOVE_SPRITE ", 13) == 0) {
-                        int start_x, start_y, end_x, end_y, delay_ms;
-                        sscanf(command + 13, "%d %d %d %d %d", &start_x, &start_y, &end_x, &end_y, &delay_ms);
-                        move_sprite(start_x, start_y, end_x, end_y, delay_ms);
-                    } else if (strncmp(command, "/SCROLL_MAP ", 12) == 0) {
-                        int scroll_amount, delay_ms;
-                        sscanf(command + 12, "%d %d", &scroll_amount, &delay_ms);
-                        scroll_map(scroll_amount, delay_ms);
-                    } else if (strncmp(command, "/IMAGE ", 7) == 0) {
-                        int x, y, width, height;
-                        char image_data[BUFFER_SIZE];
-                        sscanf(command + 7, "%d %d %d %d %s", &x, &y, &width, &height, image_data);
-                        // Ensure the image data length matches the expected size
-                        int expected_length = width * height;
-                        if (strlen(image_data) == expected_length) {
-                            drawImage(x, y, width, height, image_data);
-                        } else {
-                            uart_puts(uart0, "\nInvalid image data length.\n");
-                        }
-                    } else if (strncmp(command, "/PETSCII ", 9) == 0) {
-                        int x, y;
-                        char color_code[20];
-                        char text[BUFFER_SIZE];
-                        sscanf(command + 9, "%d %d %s %[^\n]", &x, &y, color_code, text);
-                        drawPETSCIIString(x, y, text, parse_color_code(color_code));
-                    } else {
-                        uart_puts(uart0, "\nUnknown command.\n");
-                    }
-
-                    index = 0; // Reset command index
-                }
+// Execute one complete command line (starting with '/')
+void execute_command(const char *command) {
+    TRACE(TRACE_CMD_BEGIN, command[1]);
+    console_flush();    // text sent before the command is drawn before it
+
+    if (strncmp(command, "/TEXT ", 6) == 0 || strncmp(command, "TEXT ", 5) == 0) {
+        char color_code[20];
+        sscanf(command + 6, "%s", color_code);
+        change_text_color(parse_color_code(color_code));
+    } else if (strncmp(command, "/BACK ", 6) == 0 || strncmp(command, "BACK ", 5) == 0) {
+        char color_code[20];
+        sscanf(command + 6, "%s", color_code);
+        change_background_color(parse_color_code(color_code));
+    } else if (strncmp(command, "/VC", 3) == 0) {
+        int n;
+        if (sscanf(command + 3, "%d", &n) == 1) {
+            if (n < 1 || n > vc_count) {
+                reply("\nInvalid console.\n");
             } else {
-                if (c == '/') {
-                    command_mode = true;
-                    index = 0;
-                    command[index++] = c; // Start with '/'
-                } else if (c == '\033') { // ANSI escape sequence start
-                    ansi_mode = true;
-                    ansi_index = 0;
-                } else {
-                    uart_putc(uart0, c);
-                    update_console(c);
-
-                    if (c == '\r' || c == '\n') {
-                        break;
-                    }
-                }
+                show_console(n - 1);
+            }
+        } else {
+            printf("\nConsoles: %d of %dx%d, showing %d, output to %d\n", vc_count, console_cols, console_rows,
+                   vc_shown + 1, vc_active + 1);
+        }
+    } else if (strncmp(command, "/WINDOW", 7) == 0) {
+        int id, col, row, width, height;
+        int count = sscanf(command + 7, "%d %d %d %d %d", &id, &col, &row, &width, &height);
+        bool clear = strstr(command, "CLEAR") != NULL, off = strstr(command, "OFF") != NULL;
+        if (count < 1) {
+            window_report();
+        } else if (id == 0 && count == 1 && !clear && !off) {
+            select_window(-1);
+        } else if (id < 1 || id > MAX_WINDOWS) {
+            reply("\nInvalid window.\n");
+        } else if (count == 5) {
+            if (!define_window(id - 1, col - 1, row - 1, width, height, strstr(command, "NOWRAP") == NULL)) {
+                reply("\nInvalid window.\n");
+            }
+        } else if (!windows[id - 1].defined) {
+            reply("\nNo such window.\n");
+        } else if (clear) {
+            clear_window(id - 1);
+        } else if (off) {
+            delete_window(id - 1);
+        } else {
+            select_window(id - 1);
+        }
+    } else if (strncmp(command, "/SCROLLREGION", 13) == 0) {
+        int top = 1, bottom = console_rows;
+        sscanf(command + 13, "%d %d", &top, &bottom);
+        if (!set_scroll_region(top - 1, bottom - 1)) {
+            reply("\nInvalid scroll region.\n");
+        }
+    } else if (strncmp(command, "/SCROLLBACK", 11) == 0) {
+        int lines;
+        if (strstr(command, "CLEAR") != NULL) {
+            show_scrollback(0);
+            scrollback_clear();
+        } else if (sscanf(command + 11, "%d", &lines) == 1) {
+            show_scrollback(lines);
+        } else {
+            printf("\nScrollback: %d of %d lines, showing %d back\n", scrollback_lines(), SCROLLBACK_LINES,
+                   scrollback_offset);
+        }
+    } else if (strncmp(command, "/CLS", 4) == 0) {
+        clear_screen();
+        //uart_puts(uart0, "\nScreen cleared.\n"); // Optional feedback
+    } else if (strncmp(command, "/LINE ", 6) == 0) {
+        int x1, y1, x2, y2;
+        char color_code[20];
+        sscanf(command + 6, "%d %d %d %d %s", &x1, &y1, &x2, &y2, color_code);
+        drawLine(x1, y1, x2, y2, parse_color_code(color_code));
+    } else if (strncmp(command, "/RECT ", 6) == 0) {
+        int x, y, width, height;
+        char color_code[20];
+        sscanf(command + 6, "%d %d %d %d %s", &x, &y, &width, &height, color_code);
+        drawRect(x, y, width, height, parse_color_code(color_code));
+    } else if (strncmp(command, "/FILLRECT ", 10) == 0) {
+        int x, y, width, height;
+        char color_code[20];
+        sscanf(command + 10, "%d %d %d %d %s", &x, &y, &width, &height, color_code);
+        fillRect(x, y, width, height, parse_color_code(color_code));
+    } else if (strncmp(command, "/RECOLOR ", 9) == 0) {
+        int x, y, width, height;
+        char from[20], to[20];
+        if (sscanf(command + 9, "%d %d %d %d %19s %19s", &x, &y, &width, &height, from, to) == 6) {
+            vga_recolor(x, y, width, height, parse_color_code(from), parse_color_code(to));
+        }
+    } else if (strncmp(command, "/CIRCLE ", 8) == 0) {
+        int x, y, radius;
+        char color_code[20];
+        sscanf(command + 8, "%d %d %d %s", &x, &y, &radius, color_code);
+        drawCircle(x, y, radius, parse_color_code(color_code));
+    } else if (strncmp(command, "/FILLCIRCLE ", 12) == 0) {
+        int x, y, radius;
+        char color_code[20];
+        sscanf(command + 12, "%d %d %d %s", &x, &y, &radius, color_code);
+        fillCircle(x, y, radius, parse_color_code(color_code));
+    } else if (strncmp(command, "/ROUNDRECT ", 11) == 0) {
+        int x, y, width, height, radius;
+        char color_code[20];
+        sscanf(command + 11, "%d %d %d %d %d %s", &x, &y, &width, &height, &radius, color_code);
+        drawRoundRect(x, y, width, height, radius, parse_color_code(color_code));
+    } else if (strncmp(command, "/FILLROUNDRECT ", 15) == 0) {
+        int x, y, width, height, radius;
+        char color_code[20];
+        sscanf(command + 15, "%d %d %d %d %d %s", &x, &y, &width, &height, &radius, color_code);
+        fillRoundRect(x, y, width, height, radius, parse_color_code(color_code));
+    } else if (strncmp(command, "/FONT ", 6) == 0 || strncmp(command, "FONT ", 5) == 0) {
+        if (strstr(command, "STANDARD") != NULL) {
+            change_font(true);
+            reply("\nFont set to Standard 5x7.\n");
+        } else if (strstr(command, "BRL4") != NULL) {
+            change_font(false);
+            reply("\nFont set to BRL4.\n");
+        } else {
+            reply("\nInvalid font type.\n");
+        }
+    } else if (strncmp(command, "/SMILEY", 7) == 0 || strncmp(command, "SMILEY", 6) == 0) {
+        int x = 50, y = 50;
+        saveBackground(x, y); // Save initial background state
+        for (int i = 0; i < 50; i++) {
+            clearSprite(x, y, 8, 8); // Clear previous sprite
+            x += 2; // Update position
+            y += 2;
+            saveBackground(x, y); // Save background at new position
+            drawSprite(x, y, smiley, 8, 8, YELLOW); // Draw new sprite
+            sleep_ms(100); // Delay for a short period
+        }
+    } else if (strncmp(command, "/MOVE_SPRITE ", 13) == 0) {
+        int start_x, start_y, end_x, end_y, delay_ms;
+        sscanf(command + 13, "%d %d %d %d %d", &start_x, &start_y, &end_x, &end_y, &delay_ms);
+        move_sprite(start_x, start_y, end_x, end_y, delay_ms);
+    } else if (strncmp(command, "/SCROLL_MAP ", 12) == 0) {
+        int scroll_amount, delay_ms;
+        sscanf(command + 12, "%d %d", &scroll_amount, &delay_ms);
+        scroll_map(scroll_amount, delay_ms);
+    } else if (strncmp(command, "/IMAGE ", 7) == 0) {
+        int x, y, width, height;
+        char image_data[BUFFER_SIZE];
+        sscanf(command + 7, "%d %d %d %d %s", &x, &y, &width, &height, image_data);
+        // Ensure the image data length matches the expected size
+        int expected_length = width * height;
+        if (strlen(image_data) == expected_length) {
+            drawImage(x, y, width, height, image_data);
+        } else {
+            reply("\nInvalid image data length.\n");
+        }
+    } else if (strncmp(command, "/PETSCII ", 9) == 0) {
+        int x, y;
+        char color_code[20];
+        char text[BUFFER_SIZE];
+        sscanf(command + 9, "%d %d %s %[^\n]", &x, &y, color_code, text);
+        drawPETSCIIString(x, y, text, parse_color_code(color_code));
+    } else if (strncmp(command, "/DEFER", 6) == 0) {
+        if (strstr(command, "ON") != NULL) {
+            cmdqueue_deferred = true;
+        } else if (strstr(command, "OFF") != NULL) {
+            cmdqueue_deferred = false;
+            cmdqueue_flush();
+        } else {
+            cmdqueue_report();
+        }
+    } else if (strncmp(command, "/BUDGET ", 8) == 0) {
+        int budget_us;
+        if (sscanf(command + 8, "%d", &budget_us) == 1 && budget_us > 0) {
+            cmdqueue_budget_us = (budget_us < VGA_FRAME_US) ? budget_us : VGA_FRAME_US;
+        }
+    } else if (strncmp(command, "/LATENCY", 8) == 0) {
+        if (strstr(command, "ON") != NULL) {
+            latency_reset();
+            latency_enabled = true;
+        } else if (strstr(command, "OFF") != NULL) {
+            latency_enabled = false;
+        } else if (strstr(command, "RESET") != NULL) {
+            latency_reset();
+        } else {
+            latency_report();
+        }
+    } else if (strncmp(command, "/DAMAGE", 7) == 0) {
+#if VGA_DAMAGE_TRACKING
+        if (strstr(command, "ON") != NULL) {
+            vga_damage_enable(true);
+        } else if (strstr(command, "OFF") != NULL) {
+            vga_damage_enable(false);
+        } else if (strstr(command, "CLEAR") != NULL) {
+            vga_damage_clear();
+        } else {
+            VgaRect rects[16];
+            int n = vga_damage_rects(rects, 16);
+            printf("\nDamage: %d rect(s)\n", n);
+            for (int i = 0; i < n; i++) {
+                printf("%d %d %d %d\n", rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+            }
+        }
+#else
+        printf("\nDamage tracking disabled\n");
+#endif
+    } else if (strncmp(command, "/FLOW", 5) == 0) {
+        if (strstr(command, "NONE") != NULL) {
+            serial_set_flow_mode(FLOW_NONE);
+        } else if (strstr(command, "XON") != NULL) {
+            serial_set_flow_mode(FLOW_XONXOFF);
+        } else if (strstr(command, "RTS") != NULL) {
+            serial_set_flow_mode(FLOW_RTSCTS);
+        } else if (strstr(command, "CREDIT") != NULL) {
+            serial_set_flow_mode(FLOW_CREDIT);
+        } else {
+            serial_rx_report();
+        }
+    } else if (strncmp(command, "/BAUD", 5) == 0) {
+        unsigned long baud;
+        if (strstr(command, "AUTO") != NULL) {
+            uart_puts(uart0, "\nSend 0x55 at the new rate.\n");
+            if (serial_autobaud(10000000) != 0) {
+                serial_baud_report();
+            } else {
+                uart_puts(uart0, "\nNo sync received, rate unchanged.\n");
+            }
+        } else if (sscanf(command + 5, "%lu", &baud) == 1) {
+            bool supported = false;
+            for (int i = 0; i < serial_baud_count; i++) {
+                if (serial_baud_rates[i] == baud) supported = true;
+            }
+            if (supported) {
+                printf("\nSwitching to %lu baud.\n", baud);
+                serial_set_baud(baud);
+            } else {
+                uart_puts(uart0, "\nUnsupported baud rate.\n");
+            }
+        } else {
+            serial_baud_report();
+        }
+    } else if (strncmp(command, "/PARALLEL", 9) == 0) {
+        if (strstr(command, "ON") != NULL) {
+            parallel_enable(true);
+        } else if (strstr(command, "OFF") != NULL) {
+            parallel_enable(false);
+        } else {
+            parallel_report();
+        }
+    } else if (strncmp(command, "/SPI", 4) == 0) {
+        if (strstr(command, "ON") != NULL) {
+            spi_slave_enable(true);
+        } else if (strstr(command, "OFF") != NULL) {
+            spi_slave_enable(false);
+        } else {
+            spi_slave_report();
+        }
+    } else if (strncmp(command, "/VDP", 4) == 0) {
+        if (strstr(command, "ON") != NULL) {
+            cmdqueue_flush();
+            console_flush();
+            crtc_enable(false);     // they share the emulation RAM
+            vdp_enable(true);
+        } else {
+            vdp_report();
+        }
+    } else if (strncmp(command, "/CRTC", 5) == 0) {
+        if (strstr(command, "ON") != NULL) {
+            cmdqueue_flush();
+            console_flush();
+            vdp_enable(false);
+            crtc_enable(true);
+        } else {
+            crtc_report();
+        }
+    } else if (strncmp(command, "/CONSOLE", 8) == 0) {
+        if (strstr(command, "IMMEDIATE") != NULL) {
+            console_batched = false;
+            console_flush();
+        } else if (strstr(command, "BATCHED") != NULL) {
+            console_batched = true;
+        } else if (strstr(command, "GLYPHS") != NULL) {
+            int entries;
+            if (sscanf(command + 8, " GLYPHS %d", &entries) == 1) glyph_cache_resize(entries);
+        } else {
+            console_report();
+        }
+    } else if (strncmp(command, "/CURSOR", 7) == 0) {
+        int frames;
+        if (strstr(command, "OFF") != NULL) {
+            cursor_shape = CURSOR_OFF;
+        } else if (strstr(command, "UNDERLINE") != NULL) {
+            cursor_shape = CURSOR_UNDERLINE;
+        } else if (strstr(command, "BLOCK") != NULL) {
+            cursor_shape = CURSOR_BLOCK;
+        }
+        const char *rate = strpbrk(command + 7, "0123456789");
+        if (rate != NULL && sscanf(rate, "%d", &frames) == 1) {
+            cursor_blink_frames = frames;
+        }
+        if (strlen(command) <= 8) {
+            printf("\nCursor: %s, blink every %d frames\n",
+                   cursor_shape == CURSOR_OFF ? "off" : cursor_shape == CURSOR_BLOCK ? "block" : "underline",
+                   cursor_blink_frames);
+        }
+    } else if (strncmp(command, "/TRACE", 6) == 0) {
+        if (strstr(command, "CLEAR") != NULL) {
+            trace_clear();
+        } else {
+            trace_dump();
+        }
+    } else {
+        reply("\nUnknown command.\n");
+    }
+
+    TRACE(TRACE_CMD_END, command[1]);
+}
+
+// Commands that configure or query the firmware rather than draw. These run
+// as soon as they are parsed, even in deferred mode.
+bool is_control_command(const char *command) {
+    return strncmp(command, "/DEFER", 6) == 0 || strncmp(command, "/BUDGET", 7) == 0 ||
+           strncmp(command, "/LATENCY", 8) == 0 || strncmp(command, "/DAMAGE", 7) == 0 ||
+           strncmp(command, "/FLOW", 5) == 0 || strncmp(command, "/BAUD", 5) == 0 ||
+           strncmp(command, "/PARALLEL", 9) == 0 || strncmp(command, "/SPI", 4) == 0 ||
+           strncmp(command, "/VDP", 4) == 0 || strncmp(command, "/CRTC", 5) == 0 ||
+           strncmp(command, "/CONSOLE", 8) == 0 || strncmp(command, "/CURSOR", 7) == 0 ||
+           strncmp(command, "/TRACE", 6) == 0;
+}
+
+// Apply one parsed unit of input, now or from the command queue
+void execute_unit(const QueueEntry *unit) {
+    latency_begin(unit->arrival_us);
+    vga_overlay_hide();     // the cursor comes back on a later frame
+    if (unit->kind != QUEUE_COMMAND && scrollback_offset != 0 && console_shown()) {
+        show_scrollback(0);     // console output returns to the live view
+    }
+    if (unit->kind == QUEUE_COMMAND) {
+        execute_command(unit->data);
+    } else if (unit->kind == QUEUE_ESCAPE) {
+        AnsiSequence seq;
+        memset(&seq, 0, sizeof(seq));
+        memcpy(&seq, unit->data, unit->len);
+        handle_ansi_escape(&seq);
+    } else {
+        console_note_arrival(unit->arrival_us);
+        for (int i = 0; i < unit->len; i++) {
+            update_console(unit->data[i]);
+        }
+    }
+    latency_end();
+}
+
+// A /FILLRECT from a batch, clipped to the screen
+typedef struct {
+    short x0, y0, x1, y1;
+    char color;
+    bool whole;     // entirely on the screen, so clipping changed nothing
+    bool merged;    // grown by coalescing, drawn from these fields
+    short index;    // position in the batch
+} BatchFill;
+
+#define MAX_FILL_RUN 32
+
+bool parse_batch_fill(const QueueEntry *unit, BatchFill *fill) {
+    int x, y, width, height;
+    char color_code[20];
+    if (unit->kind != QUEUE_COMMAND || strncmp(unit->data, "/FILLRECT ", 10) != 0) return false;
+    if (sscanf(unit->data + 10, "%d %d %d %d %19s", &x, &y, &width, &height, color_code) != 5) return false;
+    fill->color = parse_color_code(color_code);
+    fill->whole = x >= 0 && y >= 0 && width > 0 && height > 0 &&
+                  x + width <= SCREEN_WIDTH && y + height <= SCREEN_HEIGHT;
+    fill->merged = false;
+    fill->x0 = (x < 0) ? 0 : (x > SCREEN_WIDTH - 1) ? SCREEN_WIDTH - 1 : x;
+    fill->y0 = (y < 0) ? 0 : (y > SCREEN_HEIGHT - 1) ? SCREEN_HEIGHT - 1 : y;
+    fill->x1 = (x + width - 1 > SCREEN_WIDTH - 1) ? SCREEN_WIDTH - 1 : x + width - 1;
+    fill->y1 = (y + height - 1 > SCREEN_HEIGHT - 1) ? SCREEN_HEIGHT - 1 : y + height - 1;
+    if (fill->x1 < 0 || fill->y1 < 0) fill->x1 = -1; // Draws nothing
+    return true;
+}
+
+static bool fills_overlap(const BatchFill *a, const BatchFill *b) {
+    return a->x0 <= b->x1 && b->x0 <= a->x1 && a->y0 <= b->y1 && b->y0 <= a->y1;
+}
+
+// Two fills of one color whose union is a rectangle: the same rows and
+// touching or overlapping columns, or the other way round
+static bool fills_join(const BatchFill *a, const BatchFill *b) {
+    if (!a->whole || !b->whole || a->color != b->color) return false;
+    if (a->y0 == b->y0 && a->y1 == b->y1) return a->x0 <= b->x1 + 1 && b->x0 <= a->x1 + 1;
+    if (a->x0 == b->x0 && a->x1 == b->x1) return a->y0 <= b->y1 + 1 && b->y0 <= a->y1 + 1;
+    return false;
+}
+
+// Coalesce the run: fills that join become one rectangle, drawn once, as
+// long as no fill between them in the run touches either of them (which
+// would see them drawn in a different order). Returns the new count.
+static int coalesce_fills(BatchFill *fills, int count) {
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            if (!fills_join(&fills[i], &fills[j])) continue;
+            bool blocked = false;
+            for (int k = i + 1; k < j && !blocked; k++) {
+                blocked = fills_overlap(&fills[k], &fills[i]) || fills_overlap(&fills[k], &fills[j]);
+            }
+            if (blocked) continue;
+            if (fills[j].x0 < fills[i].x0) fills[i].x0 = fills[j].x0;
+            if (fills[j].y0 < fills[i].y0) fills[i].y0 = fills[j].y0;
+            if (fills[j].x1 > fills[i].x1) fills[i].x1 = fills[j].x1;
+            if (fills[j].y1 > fills[i].y1) fills[i].y1 = fills[j].y1;
+            fills[i].merged = true;
+            memmove(&fills[j], &fills[j + 1], (count - j - 1) * sizeof(BatchFill));
+            count--;
+            j = i;      // the grown fill may now join ones it skipped
+        }
+    }
+    return count;
+}
+
+// A coalesced fill, drawn as execute_unit would draw its command
+static void execute_merged_fill(const QueueEntry *unit, const BatchFill *fill) {
+    latency_begin(unit->arrival_us);
+    vga_overlay_hide();
+    fillRect(fill->x0, fill->y0, fill->x1 - fill->x0 + 1, fill->y1 - fill->y0 + 1, fill->color);
+    latency_end();
+}
+
+// Run a sequence of fills from a batch. Fills of one color that make one
+// rectangle together are coalesced, and fills that a later fill in the run
+// paints over completely are dropped. If the remaining fills do not
+// overlap, their order cannot matter, so they run top to bottom and the
+// writes sweep the framebuffer in address order.
+void execute_fill_run(const QueueEntry *units, BatchFill *fills, int count) {
+    int live = 0;
+    console_flush();
+    count = coalesce_fills(fills, count);
+    for (int i = 0; i < count; i++) {
+        bool covered = fills[i].x1 < fills[i].x0 || fills[i].y1 < fills[i].y0;
+        for (int j = i + 1; j < count && !covered; j++) {
+            covered = fills[j].x0 <= fills[i].x0 && fills[j].x1 >= fills[i].x1 &&
+                      fills[j].y0 <= fills[i].y0 && fills[j].y1 >= fills[i].y1;
+        }
+        if (!covered) fills[live++] = fills[i];
+    }
+
+    bool disjoint = true;
+    for (int i = 0; i < live && disjoint; i++) {
+        for (int j = i + 1; j < live && disjoint; j++) {
+            disjoint = fills[i].x1 < fills[j].x0 || fills[j].x1 < fills[i].x0 ||
+                       fills[i].y1 < fills[j].y0 || fills[j].y1 < fills[i].y0;
+        }
+    }
+    if (disjoint) {
+        for (int i = 1; i < live; i++) {
+            BatchFill f = fills[i];
+            int j = i - 1;
+            while (j >= 0 && (fills[j].y0 > f.y0 || (fills[j].y0 == f.y0 && fills[j].x0 > f.x0))) {
+                fills[j + 1] = fills[j];
+                j--;
             }
+            fills[j + 1] = f;
         }
     }
+
+    for (int i = 0; i < live; i++) {
+        if (fills[i].merged) {
+            execute_merged_fill(&units[fills[i].index], &fills[i]);
+        } else {
+            execute_unit(&units[fills[i].index]);
+        }
+    }
+}
+
+// Queue executor: a single unit, or the members of a group/transaction
+void execute_units(const QueueEntry *units, int count) {
+    static BatchFill fills[MAX_FILL_RUN];
+    int i = 0;
+    while (i < count) {
+        int run = 0;
+        while (count > 1 && i + run < count && run < MAX_FILL_RUN && parse_batch_fill(&units[i + run], &fills[run])) {
+            fills[run].index = run;
+            run++;
+        }
+        if (run > 1) {
+            execute_fill_run(&units[i], fills, run);
+            i += run;
+        } else {
+            execute_unit(&units[i]);
+            i++;
+        }
+    }
+}
+
+// Transactions: /BEGIN (or STX) ... /COMMIT (or ETX) buffers everything in
+// between and applies it as one batch, without echoing the input back
+bool in_transaction = false;
+
+void begin_transaction() {
+    in_transaction = true;
+    cmdqueue_begin_group();
+}
+
+void commit_transaction() {
+    if (!in_transaction) return;
+    in_transaction = false;
+    if (!cmdqueue_end_group()) {
+        reply("\nTransaction too large, applied in immediate mode.\n");
+    }
+}
+
+// Hand a parsed command to the queue (which executes it immediately unless
+// deferred mode or a group is active)
+void submit_command(const char *command, uint32_t arrival_us) {
+    if (strncmp(command, "/GROUP", 6) == 0) {
+        cmdqueue_begin_group();
+    } else if (strncmp(command, "/ENDGROUP", 9) == 0) {
+        cmdqueue_end_group();
+    } else if (strncmp(command, "/BEGIN", 6) == 0) {
+        begin_transaction();
+    } else if (strncmp(command, "/COMMIT", 7) == 0) {
+        commit_transaction();
+    } else if (is_control_command(command)) {
+        execute_command(command);
+    } else {
+        cmdqueue_submit(QUEUE_COMMAND, command, strlen(command), arrival_us);
+    }
+}
+
+// Parser state, one per transport so interleaved input cannot mix
+typedef struct {
+    int index;
+    char command[BUFFER_SIZE];
+    bool command_mode;
+    AnsiParser ansi;
+    PortParser port;
+    VdpParser vdp;
+    CrtcParser crtc;
+} InputParser;
+
+static const Transport *const transports[] = {
+    &uart_transport, &usb_transport, &parallel_transport, &spi_transport, &inject_transport
+};
+#define TRANSPORT_COUNT (sizeof(transports) / sizeof(transports[0]))
+static InputParser parsers[TRANSPORT_COUNT];
+
+// Transport of the input being parsed; replies and echo go back there
+static const Transport *active_transport = &uart_transport;
+
+void reply(const char *text) {
+    active_transport->write(text, strlen(text));
+}
+
+// Echo typed input back, except inside a transaction, when a credit host
+// is reading the UART return channel for grants, or for the parallel bus
+// and SPI, whose replies are forwarded to the UART (where bulk input echoed
+// at bus speed would only stall the parser)
+void echo(const char *data, int len) {
+    if (in_transaction) return;
+    if (active_transport == &uart_transport && serial_flow_mode == FLOW_CREDIT) return;
+    if (active_transport == &parallel_transport || active_transport == &spi_transport) return;
+    active_transport->write(data, len);
+}
+
+// Parse one received run in place. Plain console text is handed on in
+// stretches that point straight into the run.
+void process_input(InputParser *p, const uint8_t *data, size_t len, uint32_t arrival_us) {
+    size_t i = 0;
+    while (i < len) {
+        char c = data[i];
+
+        if (vdp_active) {
+            i += vdp_input(&p->vdp, &data[i], len - i, active_transport);
+        } else if (crtc_active) {
+            i += crtc_input(&p->crtc, &data[i], len - i);
+        } else if (p->port.op != 0) {
+            i += vram_port_input(&p->port, &data[i], len - i, active_transport);
+        } else if (ansi_active(&p->ansi)) {
+            switch (ansi_parse(&p->ansi, c)) {
+            case ANSI_DISPATCH:
+                cmdqueue_submit(QUEUE_ESCAPE, (const char *)&p->ansi.seq, ansi_sequence_size(&p->ansi.seq), arrival_us);
+                break;
+            case ANSI_EXECUTE:  // a control character inside the sequence
+                cmdqueue_submit(QUEUE_TEXT, &c, 1, arrival_us);
+                break;
+            }
+            i++;
+        } else if (p->command_mode) {
+            echo(&c, 1);
+            p->command[p->index++] = c;
+
+            if (c == '\r' || c == '\n' || p->index == BUFFER_SIZE - 1) {
+                p->command[p->index] = '\0';
+                p->command_mode = false;
+                submit_command(p->command, arrival_us);
+                p->index = 0; // Reset command index
+            }
+            i++;
+        } else if (c == '/') {
+            p->command_mode = true;
+            p->index = 0;
+            p->command[p->index++] = c; // Start with '/'
+            i++;
+        } else if (c == '\033') { // ANSI escape sequence start
+            ansi_begin(&p->ansi);
+            i++;
+        } else if (c == '\002') { // STX: binary /BEGIN
+            begin_transaction();
+            i++;
+        } else if (c == '\003') { // ETX: binary /COMMIT
+            commit_transaction();
+            i++;
+        } else if (c == PORT_DLE) { // Binary memory port operation
+            vram_port_begin(&p->port);
+            i++;
+        } else {
+            size_t start = i;
+            while (i < len && data[i] != '/' && data[i] != '\033' && data[i] != '\002' && data[i] != '\003' &&
+                   data[i] != PORT_DLE) {
+                i++;
+            }
+            echo((const char *)&data[start], i - start);
+            cmdqueue_submit(QUEUE_TEXT, (const char *)&data[start], i - start, arrival_us);
+        }
+    }
+}
+
+// Parse whatever each transport has received, then do the per-pass
+// housekeeping
+void handle_serial_input() {
+    bool idle = true;
+    for (size_t t = 0; t < TRANSPORT_COUNT; t++) {
+        const uint8_t *data;
+        uint32_t arrival_us;
+        size_t len = transports[t]->receive(&data, &arrival_us);
+        if (len == 0) continue;
+        idle = false;
+        TRACE(TRACE_RX, len);
+        active_transport = transports[t];
+        process_input(&parsers[t], data, len, arrival_us);
+        transports[t]->release(len);
+    }
+    if (idle) {
+        latency_poll(); // Retire measurements while the line is idle
+    }
+    serial_rx_service();
+    cmdqueue_service();
+    console_service();
+    vdp_service();
+    crtc_service();
+    cursor_service();
 }
 
 // Function to initialize the tile map
@@ -732,20 +2132,21 @@ void handle_serial_input() {
 // Function to set a tile in the tile map
 void set_tile(int row, int col, char character, char color, char bgcolor, bool is_sprite) {
     if (row >= 0 && row < ROWS && col >= 0 && col < COLS) {
-        tile_map[row][col].character = character;
-        tile_map[row][col].color = color;
-        tile_map[row][col].bgcolor = bgcolor;
-        tile_map[row][col].is_sprite = is_sprite;
+        tile_map[row][col] = cell_make(character, color, bgcolor);
+        if (is_sprite) {
+            tile_sprites[row][col >> 5] |= 1u << (col & 31);
+        } else {
+            tile_sprites[row][col >> 5] &= ~(1u << (col & 31));
+        }
     }
 }
 
 // Function to get a tile from the tile map
-/*Tile get_tile(int row, int col) {
+/*Cell get_tile(int row, int col) {
     if (row >= 0 && row < ROWS && col >= 0 && col < COLS) {
         return tile_map[row][col];
     } else {
-        Tile empty_tile = {' ', current_text_color, current_bg_color, false};
-        return empty_tile;
+        return cell_make(' ', current_text_color, current_bg_color);
     }
 }*/
 
@@ -753,25 +2154,19 @@ void set_tile(int row, int col, char character, char color, char bgcolor, bool i
 void render_tile_map() {
     for (int row = 0; row < ROWS; row++) {
         for (int col = 0; col < COLS; col++) {
-            Tile tile = tile_map[row][col];
-            if (tile.is_sprite) {
-                drawSprite(col * CHAR_WIDTH, row * CHAR_HEIGHT, smiley, 8, 8, tile.color);
+            Cell tile = tile_map[row][col];
+            if (tile_is_sprite(row, col)) {
+                drawSprite(col * CHAR_WIDTH, row * CHAR_HEIGHT, smiley, 8, 8, cell_fg(tile));
             } else {
-                drawChar(col * CHAR_WIDTH, row * CHAR_HEIGHT, tile.character, tile.color, tile.bgcolor, 1);
+                drawChar(col * CHAR_WIDTH, row * CHAR_HEIGHT, cell_char(tile), cell_fg(tile), cell_bg(tile), 1);
             }
         }
     }
 }
 
 void init_screen_buffer() {
-    for (int row = 0; row < ROWS; row++) {
-        for (int col = 0; col < COLS; col++) {
-            screen_buffer[row][col].character = ' ';
-            screen_buffer[row][col].color = current_text_color;
-            screen_buffer[row][col].bgcolor = current_bg_color;
-            screen_buffer[row][col].is_standard_font = true; // Default to standard font
-        }
-    }
+    cell_fill(&screen_buffer[0][0], current_cell(' '), console_rows * MAX_COLS);
+    memset(screen_attr, current_attr(), console_rows * MAX_COLS);
 }
 
 /*void populate_tile_map() {
@@ -1000,9 +2395,13 @@ void drawPETSCIIChar(int x, int y, uint8_t c, char color) {
 
 int main() {
     init_uart();
+    cmdqueue_init(execute_units);
+    vram_port_map(PORT_SCREEN_BASE, vc_cells, sizeof(vc_cells), port_cells_written);
+    vram_port_map(PORT_TILES_BASE, tile_map, sizeof(tile_map), NULL);
     initVGA();
     init_console();
     init_screen_buffer(); // Initialize the screen buffer
+    init_virtual_consoles();
     //init_tile_map(); // Initialize the tile map
 
     // Populate the tile map with some characters
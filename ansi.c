@@ -0,0 +1,185 @@
+#include <string.h>
+#include "ansi.h"
+
+enum states {
+    S_GROUND,           // no sequence in progress
+    S_ESCAPE,           // after ESC
+    S_ESC_INTER,        // ESC followed by intermediates
+    S_CSI_ENTRY,        // after ESC [
+    S_CSI_PARAM,
+    S_CSI_INTER,
+    S_CSI_IGNORE,       // malformed CSI, skipped up to its final byte
+    S_STRING,           // OSC, DCS, SOS, PM or APC, skipped up to BEL or ST
+    S_COUNT
+} ;
+
+enum classes {
+    C_CONTROL,          // C0 controls other than the ones below
+    C_BEL,
+    C_CANCEL,           // CAN, SUB
+    C_ESC,
+    C_INTER,            // 0x20-0x2f
+    C_DIGIT,            // 0-9
+    C_SEP,              // ; and :
+    C_PRIVATE,          // < = > ?
+    C_CSI,              // [
+    C_STRING,           // ] P X ^ _
+    C_FINAL,            // the rest of 0x40-0x7e
+    C_IGNORE,           // DEL and 8-bit bytes
+    C_COUNT
+} ;
+
+enum actions {
+    A_NONE,
+    A_EXECUTE,
+    A_ABORT,
+    A_CLEAR,
+    A_COLLECT,
+    A_PRIVATE,
+    A_PARAM,
+    A_SEPARATE,
+    A_ESC_DISPATCH,
+    A_CSI_DISPATCH,
+} ;
+
+#define T(action, state) (((action) << 4) | (state))
+
+static const uint8_t transitions[S_COUNT][C_COUNT] = {
+    [S_ESCAPE] = {
+        [C_CONTROL] = T(A_EXECUTE, S_ESCAPE),   [C_BEL] = T(A_EXECUTE, S_ESCAPE),
+        [C_CANCEL] = T(A_ABORT, S_GROUND),      [C_ESC] = T(A_CLEAR, S_ESCAPE),
+        [C_INTER] = T(A_COLLECT, S_ESC_INTER),  [C_DIGIT] = T(A_ESC_DISPATCH, S_GROUND),
+        [C_SEP] = T(A_ESC_DISPATCH, S_GROUND),  [C_PRIVATE] = T(A_ESC_DISPATCH, S_GROUND),
+        [C_CSI] = T(A_CLEAR, S_CSI_ENTRY),      [C_STRING] = T(A_NONE, S_STRING),
+        [C_FINAL] = T(A_ESC_DISPATCH, S_GROUND), [C_IGNORE] = T(A_NONE, S_ESCAPE),
+    },
+    [S_ESC_INTER] = {
+        [C_CONTROL] = T(A_EXECUTE, S_ESC_INTER), [C_BEL] = T(A_EXECUTE, S_ESC_INTER),
+        [C_CANCEL] = T(A_ABORT, S_GROUND),      [C_ESC] = T(A_CLEAR, S_ESCAPE),
+        [C_INTER] = T(A_COLLECT, S_ESC_INTER),  [C_DIGIT] = T(A_ESC_DISPATCH, S_GROUND),
+        [C_SEP] = T(A_ESC_DISPATCH, S_GROUND),  [C_PRIVATE] = T(A_ESC_DISPATCH, S_GROUND),
+        [C_CSI] = T(A_ESC_DISPATCH, S_GROUND),  [C_STRING] = T(A_ESC_DISPATCH, S_GROUND),
+        [C_FINAL] = T(A_ESC_DISPATCH, S_GROUND), [C_IGNORE] = T(A_NONE, S_ESC_INTER),
+    },
+    [S_CSI_ENTRY] = {
+        [C_CONTROL] = T(A_EXECUTE, S_CSI_ENTRY), [C_BEL] = T(A_EXECUTE, S_CSI_ENTRY),
+        [C_CANCEL] = T(A_ABORT, S_GROUND),      [C_ESC] = T(A_CLEAR, S_ESCAPE),
+        [C_INTER] = T(A_COLLECT, S_CSI_INTER),  [C_DIGIT] = T(A_PARAM, S_CSI_PARAM),
+        [C_SEP] = T(A_SEPARATE, S_CSI_PARAM),   [C_PRIVATE] = T(A_PRIVATE, S_CSI_PARAM),
+        [C_CSI] = T(A_CSI_DISPATCH, S_GROUND),  [C_STRING] = T(A_CSI_DISPATCH, S_GROUND),
+        [C_FINAL] = T(A_CSI_DISPATCH, S_GROUND), [C_IGNORE] = T(A_NONE, S_CSI_ENTRY),
+    },
+    [S_CSI_PARAM] = {
+        [C_CONTROL] = T(A_EXECUTE, S_CSI_PARAM), [C_BEL] = T(A_EXECUTE, S_CSI_PARAM),
+        [C_CANCEL] = T(A_ABORT, S_GROUND),      [C_ESC] = T(A_CLEAR, S_ESCAPE),
+        [C_INTER] = T(A_COLLECT, S_CSI_INTER),  [C_DIGIT] = T(A_PARAM, S_CSI_PARAM),
+        [C_SEP] = T(A_SEPARATE, S_CSI_PARAM),   [C_PRIVATE] = T(A_NONE, S_CSI_IGNORE),
+        [C_CSI] = T(A_CSI_DISPATCH, S_GROUND),  [C_STRING] = T(A_CSI_DISPATCH, S_GROUND),
+        [C_FINAL] = T(A_CSI_DISPATCH, S_GROUND), [C_IGNORE] = T(A_NONE, S_CSI_PARAM),
+    },
+    [S_CSI_INTER] = {
+        [C_CONTROL] = T(A_EXECUTE, S_CSI_INTER), [C_BEL] = T(A_EXECUTE, S_CSI_INTER),
+        [C_CANCEL] = T(A_ABORT, S_GROUND),      [C_ESC] = T(A_CLEAR, S_ESCAPE),
+        [C_INTER] = T(A_COLLECT, S_CSI_INTER),  [C_DIGIT] = T(A_NONE, S_CSI_IGNORE),
+        [C_SEP] = T(A_NONE, S_CSI_IGNORE),      [C_PRIVATE] = T(A_NONE, S_CSI_IGNORE),
+        [C_CSI] = T(A_CSI_DISPATCH, S_GROUND),  [C_STRING] = T(A_CSI_DISPATCH, S_GROUND),
+        [C_FINAL] = T(A_CSI_DISPATCH, S_GROUND), [C_IGNORE] = T(A_NONE, S_CSI_INTER),
+    },
+    [S_CSI_IGNORE] = {
+        [C_CONTROL] = T(A_EXECUTE, S_CSI_IGNORE), [C_BEL] = T(A_EXECUTE, S_CSI_IGNORE),
+        [C_CANCEL] = T(A_ABORT, S_GROUND),      [C_ESC] = T(A_CLEAR, S_ESCAPE),
+        [C_INTER] = T(A_NONE, S_CSI_IGNORE),    [C_DIGIT] = T(A_NONE, S_CSI_IGNORE),
+        [C_SEP] = T(A_NONE, S_CSI_IGNORE),      [C_PRIVATE] = T(A_NONE, S_CSI_IGNORE),
+        [C_CSI] = T(A_ABORT, S_GROUND),         [C_STRING] = T(A_ABORT, S_GROUND),
+        [C_FINAL] = T(A_ABORT, S_GROUND),       [C_IGNORE] = T(A_NONE, S_CSI_IGNORE),
+    },
+    [S_STRING] = {
+        [C_CONTROL] = T(A_NONE, S_STRING),      [C_BEL] = T(A_ABORT, S_GROUND),
+        [C_CANCEL] = T(A_ABORT, S_GROUND),      [C_ESC] = T(A_CLEAR, S_ESCAPE),
+        [C_INTER] = T(A_NONE, S_STRING),        [C_DIGIT] = T(A_NONE, S_STRING),
+        [C_SEP] = T(A_NONE, S_STRING),          [C_PRIVATE] = T(A_NONE, S_STRING),
+        [C_CSI] = T(A_NONE, S_STRING),          [C_STRING] = T(A_NONE, S_STRING),
+        [C_FINAL] = T(A_NONE, S_STRING),        [C_IGNORE] = T(A_NONE, S_STRING),
+    },
+};
+
+static inline uint8_t classify(uint8_t c) {
+    if (c < 0x20) {
+        if (c == 0x07) return C_BEL;
+        if (c == 0x18 || c == 0x1a) return C_CANCEL;
+        if (c == 0x1b) return C_ESC;
+        return C_CONTROL;
+    }
+    if (c < 0x30) return C_INTER;
+    if (c < 0x3a) return C_DIGIT;
+    if (c < 0x3c) return C_SEP;
+    if (c < 0x40) return C_PRIVATE;
+    if (c == '[') return C_CSI;
+    if (c == ']' || c == 'P' || c == 'X' || c == '^' || c == '_') return C_STRING;
+    if (c < 0x7f) return C_FINAL;
+    return C_IGNORE;
+}
+
+static inline void clear(AnsiParser *p) {
+    memset(&p->seq, 0, offsetof(AnsiSequence, params));
+}
+
+void ansi_begin(AnsiParser *p) {
+    clear(p);
+    p->state = S_ESCAPE;
+}
+
+int ansi_parse(AnsiParser *p, uint8_t c) {
+    uint8_t t = transitions[p->state][classify(c)];
+    AnsiSequence *seq = &p->seq;
+    p->state = t & 0x0f;
+
+    switch (t >> 4) {
+    case A_EXECUTE:
+        return ANSI_EXECUTE;
+    case A_ABORT:
+        return ANSI_ABORTED;
+    case A_CLEAR:
+        clear(p);
+        break;
+    case A_COLLECT:
+        seq->intermediate = c;
+        break;
+    case A_PRIVATE:
+        seq->private_mark = c;
+        break;
+    case A_PARAM:
+        if (seq->nparams == 0) {
+            seq->nparams = 1;
+            seq->params[0] = 0;
+        }
+        if (seq->nparams <= ANSI_MAX_PARAMS) {
+            uint16_t *value = &seq->params[seq->nparams - 1];
+            *value = *value * 10 + (c - '0');
+            if (*value > ANSI_MAX_VALUE) *value = ANSI_MAX_VALUE;
+        }
+        break;
+    case A_SEPARATE:
+        // An omitted first parameter still counts
+        if (seq->nparams == 0) {
+            seq->nparams = 1;
+            seq->params[0] = 0;
+        }
+        if (seq->nparams < ANSI_MAX_PARAMS) {
+            seq->params[seq->nparams++] = 0;
+        } else {
+            seq->nparams = ANSI_MAX_PARAMS + 1;     // extra parameters are dropped
+        }
+        break;
+    case A_ESC_DISPATCH:
+        seq->type = 0;
+        seq->final = c;
+        return ANSI_DISPATCH;
+    case A_CSI_DISPATCH:
+        seq->type = '[';
+        seq->final = c;
+        if (seq->nparams > ANSI_MAX_PARAMS) seq->nparams = ANSI_MAX_PARAMS;
+        return ANSI_DISPATCH;
+    }
+    return ANSI_PENDING;
+}
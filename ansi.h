@@ -0,0 +1,65 @@
+/**
+ * VT100/ANSI escape sequence parser
+ *
+ * A DEC-compatible state machine in the style of the VT500 parser: each
+ * byte after ESC is classified, and a state x class table gives the action
+ * and the next state. CSI parameters are accumulated as numbers while they
+ * arrive, so a finished sequence needs no further parsing. C0 controls in
+ * the middle of a sequence are handed back to be executed at once, CAN and
+ * SUB abort the sequence, and OSC/DCS/PM/APC strings are skipped up to
+ * their BEL or ST terminator.
+ *
+ * Only the parsing is done here; the console acts on the result.
+ */
+
+#ifndef ANSI_H
+#define ANSI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ANSI_MAX_PARAMS 16
+#define ANSI_MAX_VALUE  9999
+
+// One complete sequence
+typedef struct {
+    uint8_t type;           // '[' for CSI, 0 for a plain ESC sequence
+    uint8_t final;          // final byte
+    uint8_t private_mark;   // '<', '=', '>' or '?' before the parameters, 0 if none
+    uint8_t intermediate;   // last intermediate byte (0x20-0x2f), 0 if none
+    uint8_t nparams;
+    uint16_t params[ANSI_MAX_PARAMS];   // 0 where a parameter was omitted
+} AnsiSequence;
+
+typedef struct {
+    uint8_t state;
+    AnsiSequence seq;
+} AnsiParser;
+
+enum ansi_results {
+    ANSI_PENDING,       // byte consumed, sequence not finished
+    ANSI_DISPATCH,      // seq holds a complete sequence
+    ANSI_EXECUTE,       // byte is a control character to run now
+    ANSI_ABORTED,       // sequence dropped (CAN, SUB or a skipped string)
+} ;
+
+// Start a sequence after an ESC
+void ansi_begin(AnsiParser *p) ;
+int ansi_parse(AnsiParser *p, uint8_t c) ;
+
+static inline bool ansi_active(const AnsiParser *p) {
+    return p->state != 0;
+}
+
+// Bytes of seq worth copying (unused parameters are left out)
+static inline size_t ansi_sequence_size(const AnsiSequence *seq) {
+    return offsetof(AnsiSequence, params) + seq->nparams * sizeof(seq->params[0]);
+}
+
+// Parameter n, or def when it was omitted or zero
+static inline int ansi_param(const AnsiSequence *seq, int n, int def) {
+    return (n < seq->nparams && seq->params[n] != 0) ? seq->params[n] : def;
+}
+
+#endif
@@ -0,0 +1,47 @@
+/**
+ * Packed character cells
+ *
+ * The console (screen_buffer), the tile map and the scrollback rows store a
+ * cell in 16 bits: the character in bits 0-7, the foreground color in bits
+ * 8-11 and the background color in bits 12-15. Rows of cells are copied,
+ * compared and filled as whole words. Flags that only some cells need (the
+ * font a console cell uses, whether a tile is a sprite) are kept in planes
+ * next to the grid that needs them.
+ */
+
+#ifndef CELL_H
+#define CELL_H
+
+#include <stdint.h>
+
+typedef uint16_t Cell;
+
+static inline Cell cell_make(char c, char fg, char bg) {
+    return (uint8_t)c | ((fg & 0x0f) << 8) | ((bg & 0x0f) << 12);
+}
+
+static inline char cell_char(Cell cell) {
+    return (char)(cell & 0xff);
+}
+
+static inline char cell_fg(Cell cell) {
+    return (cell >> 8) & 0x0f;
+}
+
+static inline char cell_bg(Cell cell) {
+    return cell >> 12;
+}
+
+static inline Cell cell_with_bg(Cell cell, char bg) {
+    return (cell & 0x0fff) | ((bg & 0x0f) << 12);
+}
+
+// Fill n cells with one value. A plain loop over Cells, which the
+// compiler is free to widen into word stores without breaking aliasing.
+static inline void cell_fill(Cell *cells, Cell value, int n) {
+    for (int i = 0; i < n; i++) {
+        cells[i] = value;
+    }
+}
+
+#endif
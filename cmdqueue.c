@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "vga16_graphics.h"
+#include "cmdqueue.h"
+
+bool cmdqueue_deferred = false;
+uint32_t cmdqueue_budget_us = CMDQUEUE_DEFAULT_BUDGET_US;
+
+static QueueExecutor execute;
+
+// Byte ring of records: an 8-byte header followed by len bytes and a NUL.
+// A record never straddles the end of the ring; when one does not fit, the
+// tail wraps to 0, wrapped is set and wrap_end remembers where the old data
+// stopped (which may be the very end of the ring).
+typedef struct {
+    uint8_t kind;
+    uint8_t group;
+    uint16_t len;
+    uint32_t arrival_us;
+} RecordHeader;
+
+#define RECORD_SIZE(len) (sizeof(RecordHeader) + (len) + 1)
+
+// Longest run of console text kept in one record
+#define MAX_TEXT_RUN 256
+
+static uint8_t ring[CMDQUEUE_BYTES] __attribute__((aligned(4)));
+static uint32_t ring_head = 0, ring_tail = 0, wrap_end = CMDQUEUE_BYTES;
+static bool wrapped = false;            // the tail is behind the head
+static uint32_t last_record;            // offset of the newest record
+static int queue_count = 0;
+
+static uint8_t open_group = 0;          // group being received, 0 if none
+static uint8_t next_group = 1;
+static bool group_spilled = false;      // open group overflowed the ring
+
+static uint32_t window_frame;           // frame of the current drain window
+static bool window_used;                // something already ran in it
+
+static uint32_t stat_entries, stat_groups, stat_frames, stat_overruns, stat_forced, stat_spills;
+
+void cmdqueue_init(QueueExecutor executor) {
+    execute = executor;
+}
+
+static RecordHeader *header_at(uint32_t offset) {
+    return (RecordHeader *)&ring[offset];
+}
+
+static void view_at(uint32_t offset, QueueEntry *e) {
+    RecordHeader *h = header_at(offset);
+    e->kind = h->kind;
+    e->group = h->group;
+    e->len = h->len;
+    e->arrival_us = h->arrival_us;
+    e->data = (const char *)&ring[offset + sizeof(RecordHeader)];
+}
+
+// Reserve size bytes for a new record. Returns its offset, or -1 if full.
+static int reserve(uint32_t size) {
+    if (queue_count == 0) {
+        ring_head = ring_tail = 0;
+        wrap_end = CMDQUEUE_BYTES;
+        wrapped = false;
+    }
+    // Keep records 4-byte aligned so headers can be read in place
+    size = (size + 3) & ~3u;
+    if (!wrapped) {
+        if (CMDQUEUE_BYTES - ring_tail >= size) {
+            ring_tail += size;
+            return ring_tail - size;
+        }
+        if (ring_head > size) {
+            wrap_end = ring_tail;
+            wrapped = true;
+            ring_tail = size;
+            return 0;
+        }
+        return -1;
+    }
+    if (ring_head - ring_tail > size) {
+        ring_tail += size;
+        return ring_tail - size;
+    }
+    return -1;
+}
+
+static void release_head() {
+    RecordHeader *h = header_at(ring_head);
+    ring_head += (RECORD_SIZE(h->len) + 3) & ~3u;
+    if (wrapped && ring_head == wrap_end) {
+        ring_head = 0;
+        wrap_end = CMDQUEUE_BYTES;
+        wrapped = false;
+    }
+    queue_count--;
+}
+
+// Run the entry at the head of the queue, or all of its group
+static void run_next() {
+    static QueueEntry batch[CMDQUEUE_MAX_BATCH];
+    uint8_t group = header_at(ring_head)->group;
+    if (group == 0) {
+        view_at(ring_head, &batch[0]);
+        execute(batch, 1);
+        release_head();
+        stat_entries++;
+        return;
+    }
+    while (queue_count > 0 && header_at(ring_head)->group == group) {
+        // Collect as much of the group as fits in one batch, run it, then
+        // release the records it pointed into
+        int n = 0;
+        uint32_t offset = ring_head, end = wrapped ? wrap_end : CMDQUEUE_BYTES;
+        for (int i = 0; i < queue_count && n < CMDQUEUE_MAX_BATCH; i++) {
+            if (header_at(offset)->group != group) break;
+            view_at(offset, &batch[n++]);
+            offset += (RECORD_SIZE(batch[n - 1].len) + 3) & ~3u;
+            if (offset == end) {
+                offset = 0;
+                end = CMDQUEUE_BYTES;
+            }
+        }
+        execute(batch, n);
+        for (int i = 0; i < n; i++) {
+            release_head();
+        }
+        stat_entries += n;
+    }
+    stat_groups++;
+}
+
+void cmdqueue_submit(uint8_t kind, const char *data, int len, uint32_t arrival_us) {
+    if (!cmdqueue_deferred && open_group == 0) {
+        QueueEntry e = { kind, 0, len, arrival_us, data };
+        execute(&e, 1);
+        return;
+    }
+
+    // Console text joins the run at the tail of the queue when it can grow
+    // in place
+    if (kind == QUEUE_TEXT && queue_count > 0) {
+        RecordHeader *tail = header_at(last_record);
+        uint32_t old_end = (last_record + RECORD_SIZE(tail->len) + 3) & ~3u;
+        uint32_t new_end = (last_record + RECORD_SIZE(tail->len + len) + 3) & ~3u;
+        uint32_t limit = wrapped ? ring_head - 1 : CMDQUEUE_BYTES;
+        if (tail->kind == QUEUE_TEXT && tail->group == open_group && old_end == ring_tail &&
+            new_end <= limit && tail->len + len <= MAX_TEXT_RUN) {
+            char *text = (char *)&ring[last_record + sizeof(RecordHeader)];
+            memcpy(text + tail->len, data, len);
+            tail->len += len;
+            text[tail->len] = '\0';
+            tail->arrival_us = arrival_us;
+            ring_tail = new_end;
+            return;
+        }
+    }
+
+    int offset = reserve(RECORD_SIZE(len));
+    if (offset < 0) {
+        if (open_group != 0) {
+            // A group that outgrows the ring is applied as far as it got;
+            // the rest of it is no longer atomic
+            open_group = 0;
+            group_spilled = true;
+            stat_spills++;
+        } else {
+            stat_forced++;
+        }
+        if (!cmdqueue_deferred) {
+            // Immediate mode: apply what was buffered, then this entry
+            cmdqueue_flush();
+        } else {
+            // Make room by running the oldest work now rather than stall
+            // the serial line for a frame
+            while ((offset = reserve(RECORD_SIZE(len))) < 0 && queue_count > 0) {
+                run_next();
+            }
+        }
+        if (offset < 0) {
+            // Not queued (immediate mode, or larger than the empty ring):
+            // apply it now, after everything submitted before it
+            QueueEntry e = { kind, 0, len, arrival_us, data };
+            execute(&e, 1);
+            return;
+        }
+    }
+
+    RecordHeader *h = header_at(offset);
+    h->kind = kind;
+    h->group = open_group;
+    h->len = len;
+    h->arrival_us = arrival_us;
+    memcpy(&ring[offset + sizeof(RecordHeader)], data, len);
+    ring[offset + sizeof(RecordHeader) + len] = '\0';
+    last_record = offset;
+    queue_count++;
+}
+
+void cmdqueue_begin_group() {
+    if (open_group != 0) return;
+    open_group = next_group++;
+    if (next_group == 0) next_group = 1;
+    group_spilled = false;
+}
+
+// Close the open group. Returns false if it overflowed the ring and was
+// partly applied in immediate mode.
+bool cmdqueue_end_group() {
+    open_group = 0;
+    if (!cmdqueue_deferred) cmdqueue_flush();
+    return !group_spilled;
+}
+
+// Drain as much as the budget allows, measured from the last vsync. Called
+// from the main loop; does nothing outside the drain window.
+void cmdqueue_service() {
+    if (queue_count == 0) return;
+    uint32_t frame = vga_frame_count;
+    if ((uint32_t)(time_us_32() - vga_frame_end_us) >= cmdqueue_budget_us) return;
+    if (frame != window_frame) {
+        window_frame = frame;
+        window_used = false;
+        stat_frames++;
+    }
+
+    while (queue_count > 0) {
+        uint8_t group = header_at(ring_head)->group;
+        if (group != 0 && (group == open_group || window_used)) {
+            break;  // incomplete, or would not start at the top of a frame
+        }
+        run_next();
+        window_used = true;
+        if ((uint32_t)(time_us_32() - vga_frame_end_us) >= cmdqueue_budget_us) {
+            if (queue_count > 0) stat_overruns++;
+            break;
+        }
+    }
+}
+
+// Execute everything queued right now, ignoring the budget
+void cmdqueue_flush() {
+    while (queue_count > 0) {
+        run_next();
+    }
+}
+
+void cmdqueue_report() {
+    printf("\nQueue: %s budget=%luus queued=%d entries=%lu groups=%lu frames=%lu budget_hits=%lu forced=%lu spills=%lu\n",
+           cmdqueue_deferred ? "deferred" : "immediate", (unsigned long)cmdqueue_budget_us, queue_count,
+           (unsigned long)stat_entries, (unsigned long)stat_groups, (unsigned long)stat_frames,
+           (unsigned long)stat_overruns, (unsigned long)stat_forced, (unsigned long)stat_spills);
+}
@@ -0,0 +1,66 @@
+/**
+ * Vblank-synchronized command queue
+ *
+ * In deferred mode, parsed commands, escape sequences and runs of console
+ * text are queued instead of executed. The queue is drained starting at
+ * vsync and stops once the per-frame microsecond budget is used up, then
+ * continues in the next frame, so drawing stays inside the blanking
+ * interval (or a chosen slice of the frame) instead of tearing mid-scan.
+ *
+ * Entries between /GROUP and /ENDGROUP (or a /BEGIN ... /COMMIT
+ * transaction) form an atomic group. A group is only started at the top
+ * of a frame's drain window and then runs to completion, so all of it
+ * appears in the same frame. Outside deferred mode a group is applied as
+ * one batch when it is closed.
+ *
+ * Entries are stored back to back in a byte ring, so short commands cost
+ * only their own length plus an 8-byte header.
+ */
+
+#ifndef CMDQUEUE_H
+#define CMDQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef CMDQUEUE_BYTES
+#define CMDQUEUE_BYTES 8192
+#endif
+
+// Entries handed to the executor in one call when running a group
+#define CMDQUEUE_MAX_BATCH 64
+
+// Default budget: the vertical blanking interval
+#define CMDQUEUE_DEFAULT_BUDGET_US 1400
+
+enum queue_entry_kinds {
+    QUEUE_COMMAND,      // one '/' command line
+    QUEUE_ESCAPE,       // one parsed ANSI escape sequence (an AnsiSequence)
+    QUEUE_TEXT,         // a run of console characters
+} ;
+
+// One queued unit. data points into the ring (NUL terminated) and stays
+// valid until the executor returns.
+typedef struct {
+    uint8_t kind;
+    uint8_t group;              // atomic group id, 0 if none
+    uint16_t len;
+    uint32_t arrival_us;        // arrival of the entry's last byte
+    const char *data;
+} QueueEntry;
+
+// Runs count entries in order. count > 1 only for the members of a group.
+typedef void (*QueueExecutor)(const QueueEntry *entries, int count) ;
+
+extern bool cmdqueue_deferred ;
+extern uint32_t cmdqueue_budget_us ;
+
+void cmdqueue_init(QueueExecutor executor) ;
+void cmdqueue_submit(uint8_t kind, const char *data, int len, uint32_t arrival_us) ;
+void cmdqueue_begin_group(void) ;
+bool cmdqueue_end_group(void) ;
+void cmdqueue_service(void) ;
+void cmdqueue_flush(void) ;
+void cmdqueue_report(void) ;
+
+#endif
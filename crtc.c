@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "vga16_graphics.h"
+#include "emulation.h"
+#include "crtc.h"
+
+extern unsigned char vga_data_array[] ;
+extern void redraw_screen() ;
+
+#define R_ROWS         6
+#define R_CURSOR_START 10
+#define R_CURSOR_END   11
+#define R_START_HI     12
+#define R_START_LO     13
+#define R_CURSOR_HI    14
+#define R_CURSOR_LO    15
+#define R_MODE         16
+
+#define MODE_BLINK     0x20
+
+bool crtc_active = false;
+
+static CrtcState *const crtc = &emulation_ram.crtc;
+
+// What is on screen, to work out what needs drawing
+static int drawn_start, drawn_rows, drawn_cursor;
+static bool drawn_blink;
+static uint32_t last_frame;
+static uint32_t stat_cells = 0;
+
+// CGA colors mapped onto ours (a permutation, so all 16 stay distinct)
+static const uint8_t cga_palette[16] = {
+    0x0,    // black         -> BLACK
+    0x4,    // blue          -> DARK_BLUE
+    0x2,    // green         -> MED_GREEN
+    0x6,    // cyan          -> LIGHT_BLUE
+    0x8,    // red           -> RED
+    0xC,    // magenta       -> MAGENTA
+    0xA,    // brown         -> ORANGE
+    0xE,    // light gray    -> LIGHT_PINK
+    0x1,    // dark gray     -> DARK_GREEN
+    0x5,    // light blue    -> BLUE
+    0x3,    // light green   -> GREEN
+    0x7,    // light cyan    -> CYAN
+    0x9,    // light red     -> DARK_ORANGE
+    0xD,    // light magenta -> PINK
+    0xB,    // yellow        -> YELLOW
+    0xF,    // white         -> WHITE
+};
+
+static inline void mark_cell(int cell) {
+    if (cell >= 0) crtc->dirty[cell >> 3] |= 1 << (cell & 7);
+}
+
+static inline bool cell_dirty(int cell) {
+    return crtc->dirty[cell >> 3] & (1 << (cell & 7));
+}
+
+static inline int reg_pair(int hi) {
+    return ((crtc->reg[hi] << 8) | crtc->reg[hi + 1]) & (CRTC_CELLS - 1);
+}
+
+void crtc_enable(bool enable) {
+    if (enable == crtc_active) return;
+    crtc_active = enable;
+    if (enable) {
+        // A blank 80x30 screen of light gray on black, with an underline
+        // cursor in the top left corner
+        memset(crtc, 0, sizeof(*crtc));
+        for (int cell = 0; cell < CRTC_CELLS; cell++) {
+            crtc->ram[cell * 2] = ' ';
+            crtc->ram[cell * 2 + 1] = 0x07;
+        }
+        crtc->reg[R_ROWS] = CRTC_ROWS;
+        crtc->reg[R_CURSOR_START] = 14;
+        crtc->reg[R_CURSOR_END] = 15;
+        crtc->reg[R_MODE] = MODE_BLINK;
+        drawn_start = drawn_rows = drawn_cursor = -1;
+        last_frame = vga_frame_count - 1;
+    } else {
+        redraw_screen();
+    }
+}
+
+static void draw_cell(int row, int col, int cell, int top, bool blink_visible, int cursor) {
+    uint8_t c = crtc->ram[cell * 2];
+    uint8_t attr = crtc->ram[cell * 2 + 1];
+    uint8_t fg = attr & 0x0f, bg;
+    if (crtc->reg[R_MODE] & MODE_BLINK) {
+        bg = (attr >> 4) & 0x07;
+        if ((attr & 0x80) && !blink_visible) fg = bg;
+    } else {
+        bg = attr >> 4;
+    }
+
+    unsigned short invert = 0;
+    if (cell == cursor) {
+        int first = crtc->reg[R_CURSOR_START] & 0x1f, last = crtc->reg[R_CURSOR_END] & 0x1f;
+        for (int line = first; line <= last && line < 16; line++) {
+            invert |= 1u << line;
+        }
+    }
+    drawCharCell(col * 8, top + row * 16, c, cga_palette[fg], cga_palette[bg], 0, invert);
+    stat_cells++;
+}
+
+// Once per frame: draw the cells that changed, or everything after the
+// start address or the number of rows changed
+void crtc_service() {
+    if (!crtc_active) return;
+    uint32_t frame = vga_frame_count;
+    if (frame == last_frame) return;
+    last_frame = frame;
+
+    int rows = crtc->reg[R_ROWS];
+    if (rows < 1 || rows > CRTC_ROWS) rows = CRTC_ROWS;
+    int top = (rows == 25) ? 40 : 0;
+    int start = reg_pair(R_START_HI);
+    bool full = (start != drawn_start || rows != drawn_rows);
+    if (rows != drawn_rows) {
+        memset(vga_data_array, 0, 640 * 480 / 2);
+        vga_damage_rect(0, 0, 640, 480);
+    }
+
+    // The cursor blinks every 16 or 32 frames, characters every 32
+    bool fast = (frame >> 3) & 1, slow = (frame >> 4) & 1;
+    int cursor = reg_pair(R_CURSOR_HI);
+    switch ((crtc->reg[R_CURSOR_START] >> 5) & 3) {
+    case 1: cursor = -1; break;
+    case 2: if (!fast) cursor = -1; break;
+    case 3: if (!slow) cursor = -1; break;
+    }
+    if (cursor != drawn_cursor) {
+        mark_cell(drawn_cursor);
+        mark_cell(cursor);
+    }
+    bool blink_changed = (slow != drawn_blink) && (crtc->reg[R_MODE] & MODE_BLINK);
+
+    for (int row = 0; row < rows; row++) {
+        for (int col = 0; col < CRTC_COLS; col++) {
+            int cell = (start + row * CRTC_COLS + col) & (CRTC_CELLS - 1);
+            if (full || cell_dirty(cell) || (blink_changed && (crtc->ram[cell * 2 + 1] & 0x80))) {
+                draw_cell(row, col, cell, top, slow, cursor);
+            }
+        }
+    }
+    memset(crtc->dirty, 0, sizeof(crtc->dirty));
+    drawn_start = start;
+    drawn_rows = rows;
+    drawn_cursor = cursor;
+    drawn_blink = slow;
+}
+
+// Register and RAM write records
+size_t crtc_input(CrtcParser *p, const uint8_t *data, size_t len) {
+    size_t i = 0;
+    while (i < len && crtc_active) {
+        uint8_t b = data[i++];
+        if (p->op == 0) {
+            if (b == 0xff) {
+                crtc_enable(false);
+            } else if ((b & 0xe0) == 0x80 || ((b & 0xe0) == 0xc0 && (b & 0x1f) < CRTC_REGS)) {
+                p->op = b;
+                p->nargs = 0;
+            }
+            continue;
+        }
+        p->args[p->nargs++] = b;
+        if ((p->op & 0xe0) == 0xc0) {
+            int r = p->op & 0x1f;
+            crtc->reg[r] = b;
+            if (r == R_CURSOR_START || r == R_CURSOR_END || r == R_MODE) {
+                // Redraw the cursor cell: the old one now, since forgetting
+                // it would leave the old cursor on the screen
+                mark_cell(drawn_cursor);
+                drawn_cursor = -2;
+                if (r == R_MODE) drawn_start = -1;
+            }
+            p->op = 0;
+        } else if (p->nargs == 2) {
+            int address = (((p->op & 0x1f) << 8) | p->args[0]) & (CRTC_RAM_SIZE - 1);
+            crtc->ram[address] = p->args[1];
+            mark_cell(address >> 1);
+            p->op = 0;
+        }
+    }
+    return i;
+}
+
+void crtc_report() {
+    printf("\nCRTC: %s start=%d cursor=%d rows=%d cells drawn=%lu\n",
+           crtc_active ? "on" : "off", reg_pair(R_START_HI), reg_pair(R_CURSOR_HI),
+           crtc->reg[R_ROWS], (unsigned long)stat_cells);
+}
@@ -0,0 +1,64 @@
+/**
+ * 6845/MDA-style text mode
+ *
+ * /CRTC ON turns the screen into an 80-column character display backed by
+ * 8 kB of character + attribute RAM (4096 cells, character byte at even
+ * addresses, attribute at odd), shown from the start address registers,
+ * so a host scrolls by changing one register. The input stream then
+ * carries register and RAM writes:
+ *
+ *   0x80|a12-8, a7-0, value   write value to RAM address a (3 bytes)
+ *   0xC0|r, value             write register r
+ *   0xFF                      leave the mode and restore the console
+ *
+ * Registers follow the 6845 numbering:
+ *
+ *   R6       rows displayed (25 or 30; 25 rows are centred)
+ *   R10      cursor start line (bits 0-4) and blink mode (bits 5-6:
+ *            0 steady, 1 hidden, 2 fast blink, 3 slow blink)
+ *   R11      cursor end line
+ *   R12/R13  start address (cell index, high/low)
+ *   R14/R15  cursor address (cell index, high/low)
+ *   R16      mode control as on the MDA/CGA mode port: bit 5 makes
+ *            attribute bit 7 blink the character instead of selecting a
+ *            bright background
+ *
+ * Attributes are CGA-style: bits 0-3 foreground, bits 4-6 background,
+ * bit 7 blink or bright background.
+ */
+
+#ifndef CRTC_H
+#define CRTC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "transport.h"
+
+#define CRTC_RAM_SIZE 8192
+#define CRTC_CELLS    (CRTC_RAM_SIZE / 2)
+#define CRTC_COLS     80
+#define CRTC_ROWS     30
+#define CRTC_REGS     17
+
+typedef struct {
+    uint8_t ram[CRTC_RAM_SIZE];
+    uint8_t reg[CRTC_REGS];
+    uint8_t dirty[CRTC_CELLS / 8];  // cells written since they were drawn
+} CrtcState;
+
+// Record parser state for one transport; op is 0 between records
+typedef struct {
+    uint8_t op;
+    uint8_t args[2];
+    int nargs;
+} CrtcParser;
+
+extern bool crtc_active ;
+
+void crtc_enable(bool enable) ;
+size_t crtc_input(CrtcParser *p, const uint8_t *data, size_t len) ;
+void crtc_service(void) ;
+void crtc_report(void) ;
+
+#endif
@@ -0,0 +1,123 @@
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "dma_ring.h"
+
+#define MAX_RINGS 4
+
+static DmaRing *rings[MAX_RINGS];
+static int ring_count = 0;
+
+static void rearm(DmaRing *ring) ;
+
+// A channel has used up its allowance: give it the space freed since
+static void dma_ring_irq() {
+    for (int i = 0; i < ring_count; i++) {
+        DmaRing *ring = rings[i];
+        uint32_t mask = 1u << ring->chan;
+        if (!(dma_hw->ints1 & mask)) continue;
+        dma_hw->ints1 = mask;
+        rearm(ring);
+        if (ring->notify) ring->notify();
+    }
+}
+
+void dma_ring_init(DmaRing *ring, uint8_t *buf, uint bits, uint32_t chunk, const volatile void *src, uint dreq) {
+    ring->buf = buf;
+    ring->bits = bits;
+    ring->chunk = chunk;
+    ring->notify = NULL;
+    ring->out = ring->armed = 0;
+    ring->full = false;
+    ring->full_count = 0;
+    ring->chan = dma_claim_unused_channel(true);
+
+    dma_channel_config c = dma_channel_get_default_config(ring->chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);              // 8-bit txfers
+    channel_config_set_read_increment(&c, false);                       // always the FIFO
+    channel_config_set_write_increment(&c, true);                       // walk the ring
+    channel_config_set_ring(&c, true, bits);                            // wrap writes on the ring
+    channel_config_set_dreq(&c, dreq);                                  // paced by the FIFO
+    dma_channel_configure(ring->chan, &c, buf, src, 0, false);
+
+    // DMA_IRQ_0 belongs to the VGA frame interrupt
+    if (ring_count == 0) {
+        irq_add_shared_handler(DMA_IRQ_1, dma_ring_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_1, true);
+    }
+    rings[ring_count++] = ring;
+}
+
+// Bytes the DMA has written so far. The interrupt moves armed and the
+// transfer count together, so read them with it held off.
+uint32_t dma_ring_received(const DmaRing *ring) {
+    uint32_t status = save_and_disable_interrupts();
+    uint32_t received = ring->armed - dma_hw->ch[ring->chan].transfer_count;
+    restore_interrupts(status);
+    return received;
+}
+
+uint32_t dma_ring_used(const DmaRing *ring) {
+    return dma_ring_received(ring) - ring->out;
+}
+
+// Once the DMA has used up its allowance, give it the free space, a chunk
+// at a time. The write address carries on where it stopped and wraps with
+// the ring. Called from the interrupt, or with interrupts disabled.
+static void rearm(DmaRing *ring) {
+    if (dma_channel_is_busy(ring->chan)) return;
+    uint32_t space = (1u << ring->bits) - (ring->armed - ring->out);
+    if (space == 0) {
+        if (!ring->full) ring->full_count++;
+        ring->full = true;
+        return;
+    }
+    if (space > ring->chunk) space = ring->chunk;
+    ring->full = false;
+    ring->armed += space;
+    dma_channel_set_trans_count(ring->chan, space, true);
+}
+
+// The channel is idle or full; make sure it is running if there is room
+static void kick(DmaRing *ring) {
+    uint32_t status = save_and_disable_interrupts();
+    rearm(ring);
+    restore_interrupts(status);
+}
+
+void dma_ring_start(DmaRing *ring) {
+    ring->out = ring->armed = 0;
+    dma_channel_set_write_addr(ring->chan, ring->buf, false);
+    dma_hw->ints1 = 1u << ring->chan;
+    dma_channel_set_irq1_enabled(ring->chan, true);
+    kick(ring);
+}
+
+// Masking the channel's interrupt first avoids the spurious completion
+// interrupt an abort can raise
+void dma_ring_stop(DmaRing *ring) {
+    dma_channel_set_irq1_enabled(ring->chan, false);
+    dma_channel_abort(ring->chan);
+    dma_hw->ints1 = 1u << ring->chan;
+}
+
+// Longest contiguous run of received bytes, or 0 if there is none
+size_t dma_ring_peek(DmaRing *ring, const uint8_t **data) {
+    kick(ring);
+    uint32_t size = 1u << ring->bits;
+    uint32_t out = ring->out;
+    uint32_t len = dma_ring_received(ring) - out;
+    if (len == 0) return 0;
+
+    // Stop at the end of the ring storage
+    uint32_t index = out & (size - 1);
+    if (len > size - index) len = size - index;
+    *data = &ring->buf[index];
+    return len;
+}
+
+void dma_ring_release(DmaRing *ring, size_t n) {
+    ring->out += n;
+    kick(ring);
+}
@@ -0,0 +1,44 @@
+/**
+ * DMA-fed receive ring
+ *
+ * A DMA channel copies bytes from a peripheral FIFO (PIO or SPI) into a
+ * power-of-two ring, wrapping with the DMA ring feature. The channel is
+ * only ever armed for the ring's free space, so it can never overwrite
+ * bytes the parser has not consumed; the peripheral's own FIFO and
+ * handshake hold off the sender while the ring is full.
+ *
+ * The channel is armed at most `chunk` bytes at a time. Its completion
+ * interrupt (DMA_IRQ_1) re-arms it straight away with whatever space is
+ * free by then and calls `notify`, so reception never waits for the main
+ * loop and a flow control line can follow the ring while the parser is
+ * busy.
+ */
+
+#ifndef DMA_RING_H
+#define DMA_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint8_t *buf;           // aligned to its size
+    uint bits;              // log2 of the size
+    uint32_t chunk;         // most bytes the channel is armed for at once
+    void (*notify)(void);   // called from the interrupt after each re-arm
+    int chan;
+    uint32_t out;           // bytes consumed
+    volatile uint32_t armed;    // bytes the DMA has been allowed to write
+    volatile bool full;
+    volatile uint32_t full_count;   // times the ring filled up
+} DmaRing;
+
+void dma_ring_init(DmaRing *ring, uint8_t *buf, uint bits, uint32_t chunk, const volatile void *src, uint dreq) ;
+void dma_ring_start(DmaRing *ring) ;
+void dma_ring_stop(DmaRing *ring) ;
+uint32_t dma_ring_received(const DmaRing *ring) ;
+uint32_t dma_ring_used(const DmaRing *ring) ;
+size_t dma_ring_peek(DmaRing *ring, const uint8_t **data) ;
+void dma_ring_release(DmaRing *ring, size_t n) ;
+
+#endif
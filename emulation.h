@@ -0,0 +1,22 @@
+/**
+ * RAM shared by the emulation modes
+ *
+ * The TMS9918A and CRTC modes are never active at the same time, so their
+ * video RAM is one union rather than 24 kB of separate buffers. Entering
+ * a mode resets its state.
+ */
+
+#ifndef EMULATION_H
+#define EMULATION_H
+
+#include "tms9918.h"
+#include "crtc.h"
+
+typedef union {
+    Tms9918 tms;
+    CrtcState crtc;
+} EmulationRam;
+
+extern EmulationRam emulation_ram ;
+
+#endif
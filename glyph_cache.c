@@ -0,0 +1,99 @@
+#include <stddef.h>
+#include "glyph_cache.h"
+
+#define NONE 0xffff
+
+static uint8_t arena[GLYPH_CACHE_ENTRIES][GLYPH_CACHE_SLOT] __attribute__((aligned(4)));
+static uint32_t keys[GLYPH_CACHE_ENTRIES];
+static uint16_t newer[GLYPH_CACHE_ENTRIES], older[GLYPH_CACHE_ENTRIES];    // recency list
+static uint16_t chain[GLYPH_CACHE_ENTRIES];     // next entry in the same bucket
+static uint16_t buckets[GLYPH_CACHE_ENTRIES];
+static uint16_t newest = NONE, oldest = NONE;
+static int used = 0;
+static int limit = GLYPH_CACHE_ENTRIES;
+static uint32_t hits = 0, misses = 0;
+static bool ready = false;
+
+static inline int bucket_of(uint32_t key) {
+    return (key * 2654435761u) % GLYPH_CACHE_ENTRIES;
+}
+
+static void unlink_entry(int e) {
+    if (newer[e] != NONE) older[newer[e]] = older[e]; else newest = older[e];
+    if (older[e] != NONE) newer[older[e]] = newer[e]; else oldest = newer[e];
+}
+
+static void push_newest(int e) {
+    newer[e] = NONE;
+    older[e] = newest;
+    if (newest != NONE) newer[newest] = e; else oldest = e;
+    newest = e;
+}
+
+static void clear() {
+    for (int b = 0; b < GLYPH_CACHE_ENTRIES; b++) {
+        buckets[b] = NONE;
+    }
+    newest = oldest = NONE;
+    used = 0;
+    ready = true;
+}
+
+uint8_t *glyph_cache_find(uint32_t key, bool *hit) {
+    if (limit == 0) {
+        misses++;
+        *hit = false;
+        return NULL;
+    }
+    if (!ready) clear();
+    int b = bucket_of(key);
+    for (int e = buckets[b]; e != NONE; e = chain[e]) {
+        if (keys[e] == key) {
+            if (e != newest) {
+                unlink_entry(e);
+                push_newest(e);
+            }
+            hits++;
+            *hit = true;
+            return arena[e];
+        }
+    }
+    misses++;
+    *hit = false;
+    int e;
+    if (used < limit) {
+        e = used++;
+    } else {
+        // Reuse the oldest entry, taking it out of its bucket
+        e = oldest;
+        unlink_entry(e);
+        uint16_t *link = &buckets[bucket_of(keys[e])];
+        while (*link != e) link = &chain[*link];
+        *link = chain[e];
+    }
+    keys[e] = key;
+    chain[e] = buckets[b];
+    buckets[b] = e;
+    push_newest(e);
+    return arena[e];
+}
+
+void glyph_cache_resize(int entries) {
+    if (entries < 0) entries = 0;
+    if (entries > GLYPH_CACHE_ENTRIES) entries = GLYPH_CACHE_ENTRIES;
+    limit = entries;
+    clear();
+}
+
+int glyph_cache_limit() {
+    return limit;
+}
+
+int glyph_cache_used() {
+    return used;
+}
+
+void glyph_cache_counts(uint32_t *hit_count, uint32_t *miss_count) {
+    *hit_count = hits;
+    *miss_count = misses;
+}
@@ -0,0 +1,44 @@
+/**
+ * Pre-rendered glyph cache
+ *
+ * Text uses few color pairs, so glyphs are kept fully expanded: the 4bpp
+ * bytes of every row of the cell, two pixels per byte, ready to be copied
+ * into the pixel array. Entries are keyed by font, character, colors and
+ * style, live in a fixed arena sized with GLYPH_CACHE_KB, and the least
+ * recently used one is reused on a miss. Only the first glyph_cache_limit
+ * entries are used, so the cache can be shrunk (or turned off with 0) at
+ * run time.
+ */
+
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef GLYPH_CACHE_KB
+#define GLYPH_CACHE_KB 8
+#endif
+
+// Bytes per entry: the biggest glyph, 8x16 at 4 bytes per row
+#define GLYPH_CACHE_SLOT 64
+#define GLYPH_CACHE_ENTRIES ((GLYPH_CACHE_KB * 1024) / GLYPH_CACHE_SLOT)
+
+#define GLYPH_FONT_5X7 0
+#define GLYPH_FONT_BIG 1
+
+static inline uint32_t glyph_key(int font, unsigned char c, char fg, char bg, unsigned char style) {
+    return c | ((fg & 0x0f) << 8) | ((bg & 0x0f) << 12) | ((uint32_t)style << 16) | ((uint32_t)font << 24);
+}
+
+// Rows of the glyph for key. On a miss the least recently used entry is
+// taken for key and *hit is false: the caller fills it before using it.
+// NULL when the cache is off.
+uint8_t *glyph_cache_find(uint32_t key, bool *hit) ;
+// Use at most entries entries (0 turns the cache off); empties the cache
+void glyph_cache_resize(int entries) ;
+int glyph_cache_limit(void) ;
+int glyph_cache_used(void) ;
+void glyph_cache_counts(uint32_t *hits, uint32_t *misses) ;
+
+#endif
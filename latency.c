@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "vga16_graphics.h"
+#include "latency.h"
+
+bool latency_enabled = false;
+
+// A command whose pixels are written but maybe not yet on screen
+typedef struct {
+    uint32_t arrival_us;    // last byte of the command received
+    uint32_t frame;         // frame whose scanout will show the change
+    short last_row;         // lowest row the command modified
+} PendingCommand;
+
+static PendingCommand pending[LATENCY_PENDING];
+static int pending_head = 0, pending_count = 0;
+static uint32_t current_arrival_us;
+
+static uint32_t samples[LATENCY_SAMPLES];
+static uint32_t sample_count, sample_max, dropped;
+static uint32_t sample_min = UINT32_MAX;
+static uint64_t sample_sum;
+
+void latency_reset() {
+    pending_count = 0;
+    sample_count = 0;
+    sample_sum = 0;
+    sample_min = UINT32_MAX;
+    sample_max = 0;
+    dropped = 0;
+}
+
+// Call before executing a command, with the arrival time of its last byte
+void latency_begin(uint32_t arrival_us) {
+    if (!latency_enabled) return;
+    current_arrival_us = arrival_us;
+    vga_reset_touched_rows();
+}
+
+// Call after executing the command. If it drew anything, work out which
+// frame will first show all of it: the current one if the beam has not yet
+// reached the first touched row, otherwise the next.
+void latency_end() {
+    if (!latency_enabled || vga_touched_bottom < 0) return;
+    if (pending_count == LATENCY_PENDING) {
+        dropped++;
+        return;
+    }
+    uint32_t status = save_and_disable_interrupts();
+    uint32_t frame = vga_frame_count;
+    int scanline = vga_scanline();
+    restore_interrupts(status);
+
+    PendingCommand *p = &pending[(pending_head + pending_count) % LATENCY_PENDING];
+    p->arrival_us = current_arrival_us;
+    p->frame = (scanline < vga_touched_top) ? frame : frame + 1;
+    p->last_row = vga_touched_bottom;
+    pending_count++;
+}
+
+static void add_sample(uint32_t us) {
+    samples[sample_count % LATENCY_SAMPLES] = us;
+    sample_count++;
+    sample_sum += us;
+    if (us < sample_min) sample_min = us;
+    if (us > sample_max) sample_max = us;
+}
+
+// Retire every pending command whose frame has been scanned out. The end of
+// frame f is reconstructed from the last vsync timestamp, and the last
+// touched row went out (479 - row) lines before that.
+void latency_poll() {
+    if (pending_count == 0) return;
+    uint32_t status = save_and_disable_interrupts();
+    uint32_t frames_done = vga_frame_count;
+    uint32_t last_end_us = vga_frame_end_us;
+    restore_interrupts(status);
+
+    while (pending_count > 0) {
+        PendingCommand *p = &pending[pending_head];
+        if ((int32_t)(frames_done - p->frame) <= 0) break;
+        uint32_t frame_end_us = last_end_us - (frames_done - 1 - p->frame) * VGA_FRAME_US;
+        uint32_t visible_us = frame_end_us - (479 - p->last_row) * VGA_LINE_US;
+        add_sample(visible_us - p->arrival_us);
+        pending_head = (pending_head + 1) % LATENCY_PENDING;
+        pending_count--;
+    }
+}
+
+void latency_report() {
+    latency_poll();
+    if (sample_count == 0) {
+        printf("\nLatency: no samples (%s)\n", latency_enabled ? "on" : "off");
+        return;
+    }
+    // p99 over the most recent samples: sort a copy (insertion sort is
+    // plenty for a few hundred entries and needs no extra code space)
+    static uint32_t sorted[LATENCY_SAMPLES];
+    int n = (sample_count < LATENCY_SAMPLES) ? sample_count : LATENCY_SAMPLES;
+    memcpy(sorted, samples, n * sizeof(sorted[0]));
+    for (int i = 1; i < n; i++) {
+        uint32_t v = sorted[i];
+        int j = i - 1;
+        while (j >= 0 && sorted[j] > v) {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = v;
+    }
+    uint32_t p99 = sorted[(n * 99) / 100];
+
+    printf("\nLatency: n=%lu min=%luus avg=%luus p99=%luus max=%luus dropped=%lu\n",
+           (unsigned long)sample_count, (unsigned long)sample_min,
+           (unsigned long)(sample_sum / sample_count), (unsigned long)p99,
+           (unsigned long)sample_max, (unsigned long)dropped);
+}
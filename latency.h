@@ -0,0 +1,35 @@
+/**
+ * End-to-end input-to-photon latency measurement
+ *
+ * For every command (or console character) that draws something, the
+ * arrival time of its last byte is compared with the moment the scanout
+ * passes the lowest framebuffer row the command touched. The visible time
+ * is derived from the vsync frame counter and the fixed line time, so no
+ * extra interrupts are needed while measuring.
+ *
+ * Enable with /LATENCY ON and query min/avg/p99 with /LATENCY.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Samples kept for the percentile (the min/avg/max cover every sample)
+#ifndef LATENCY_SAMPLES
+#define LATENCY_SAMPLES 256
+#endif
+
+// Commands drawn but not yet scanned out
+#define LATENCY_PENDING 32
+
+extern bool latency_enabled ;
+
+void latency_begin(uint32_t arrival_us) ;
+void latency_end(void) ;
+void latency_poll(void) ;
+void latency_reset(void) ;
+void latency_report(void) ;
+
+#endif
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "parallel.pio.h"
+#include "parallel.h"
+#include "dma_ring.h"
+#include "transport.h"
+
+bool parallel_enabled = false;
+
+static uint8_t par_buf[PARALLEL_RING_SIZE] __attribute__((aligned(PARALLEL_RING_SIZE)));
+static DmaRing par_ring;
+static uint par_sm;
+static bool par_loaded = false;
+
+void parallel_enable(bool enable) {
+    if (enable == parallel_enabled) return;
+    if (!par_loaded) {
+        uint offset = pio_add_program(pio1, &parallel_in_program);
+        par_sm = pio_claim_unused_sm(pio1, true);
+        parallel_in_program_init(pio1, par_sm, offset, PARALLEL_D0_PIN, PARALLEL_BUSY_PIN);
+        dma_ring_init(&par_ring, par_buf, PARALLEL_RING_BITS, PARALLEL_RING_SIZE, &pio1->rxf[par_sm],
+                      pio_get_dreq(pio1, par_sm, false));
+        par_loaded = true;
+    }
+    if (enable) {
+        pio_sm_clear_fifos(pio1, par_sm);
+        dma_ring_start(&par_ring);
+        pio_sm_set_enabled(pio1, par_sm, true);
+    } else {
+        pio_sm_set_enabled(pio1, par_sm, false);
+        dma_ring_stop(&par_ring);
+    }
+    parallel_enabled = enable;
+}
+
+static size_t parallel_receive(const uint8_t **data, uint32_t *arrival_us) {
+    if (!parallel_enabled) return 0;
+    *arrival_us = time_us_32();
+    return dma_ring_peek(&par_ring, data);
+}
+
+static void parallel_release(size_t n) {
+    dma_ring_release(&par_ring, n);
+}
+
+// The bus is input only; replies go out on the UART
+static void parallel_write(const char *data, size_t len) {
+    uart_transport.write(data, len);
+}
+
+const Transport parallel_transport = {
+    "parallel", parallel_receive, parallel_release, parallel_write
+};
+
+void parallel_report() {
+    if (!par_loaded) {
+        printf("\nParallel: off\n");
+        return;
+    }
+    printf("\nParallel: %s received=%lu used=%lu/%u full=%lu\n",
+           parallel_enabled ? "on" : "off", (unsigned long)dma_ring_received(&par_ring),
+           (unsigned long)dma_ring_used(&par_ring), PARALLEL_RING_SIZE,
+           (unsigned long)par_ring.full_count);
+}
@@ -0,0 +1,30 @@
+/**
+ * 8-bit parallel bus input
+ *
+ * A PIO state machine on pio1 (pio0's instruction memory is full with the
+ * VGA programs) latches a byte on each falling edge of /STROBE and a DMA
+ * channel moves the bytes into a receive ring (see dma_ring.h). When the
+ * ring is full the state machine's FIFO fills, BUSY stays high and the
+ * host waits. Received runs are handed to the parser through
+ * parallel_transport (see transport.h).
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdbool.h>
+
+#define PARALLEL_D0_PIN     6   // D0-D7 on GPIO 6-13
+#define PARALLEL_STROBE_PIN 14  // must follow D7
+#define PARALLEL_BUSY_PIN   15
+
+// Receive ring size (power of two, the DMA wraps on it)
+#define PARALLEL_RING_BITS  12
+#define PARALLEL_RING_SIZE  (1u << PARALLEL_RING_BITS)
+
+extern bool parallel_enabled ;
+
+void parallel_enable(bool enable) ;
+void parallel_report(void) ;
+
+#endif
@@ -0,0 +1,33 @@
+#include <string.h>
+#include "scrollback.h"
+
+static Cell ring[SCROLLBACK_LINES][SCROLLBACK_COLS];
+static uint8_t ring_attr[SCROLLBACK_LINES][SCROLLBACK_COLS];
+static int newest = -1;         // index of the newest line
+static int count = 0;
+
+void scrollback_push(const Cell *line, const uint8_t *attr) {
+    newest = (newest + 1) % SCROLLBACK_LINES;
+    memcpy(ring[newest], line, sizeof(ring[0]));
+    memcpy(ring_attr[newest], attr, sizeof(ring_attr[0]));
+    if (count < SCROLLBACK_LINES) count++;
+}
+
+int scrollback_lines() {
+    return count;
+}
+
+const Cell *scrollback_line(int n) {
+    if (n < 1 || n > count) return NULL;
+    return ring[(newest - (n - 1) + SCROLLBACK_LINES) % SCROLLBACK_LINES];
+}
+
+const uint8_t *scrollback_attr(int n) {
+    if (n < 1 || n > count) return NULL;
+    return ring_attr[(newest - (n - 1) + SCROLLBACK_LINES) % SCROLLBACK_LINES];
+}
+
+void scrollback_clear() {
+    newest = -1;
+    count = 0;
+}
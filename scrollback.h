@@ -0,0 +1,32 @@
+/**
+ * Console scrollback ring
+ *
+ * Lines that scroll off the top of the console are kept in a ring of rows
+ * of packed cells (cell.h), 2 bytes per cell, each with its row of the
+ * attribute plane (font and style flags), 1 byte per cell, both copied
+ * straight from the console. The ring is sized in kilobytes with
+ * SCROLLBACK_KB; when it is full the oldest line is dropped.
+ */
+
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#include <stdint.h>
+#include "cell.h"
+
+#ifndef SCROLLBACK_KB
+#define SCROLLBACK_KB 16
+#endif
+
+// Cells per stored line (the widest console, 106 columns of 6x8 cells)
+#define SCROLLBACK_COLS 106
+#define SCROLLBACK_LINES ((SCROLLBACK_KB * 1024) / (SCROLLBACK_COLS * 3))
+
+void scrollback_push(const Cell *line, const uint8_t *attr) ;
+int scrollback_lines(void) ;
+// Stored line n, counting back from the newest (n = 1), and its attributes
+const Cell *scrollback_line(int n) ;
+const uint8_t *scrollback_attr(int n) ;
+void scrollback_clear(void) ;
+
+#endif
@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "hardware/structs/sio.h"
+#include "hardware/structs/systick.h"
+#include "serial_rx.h"
+
+enum flow_modes serial_flow_mode = FLOW_NONE;
+
+const uint32_t serial_baud_rates[] = {
+    9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600,
+    1000000, 1500000, 2000000, 3000000
+};
+const int serial_baud_count = sizeof(serial_baud_rates) / sizeof(serial_baud_rates[0]);
+static uint32_t current_baud = SERIAL_DEFAULT_BAUD;
+
+// Single producer (the RX interrupt), single consumer (the main loop).
+// Both counters run freely; the ring index is the count modulo the size.
+static uint8_t rx_ring[SERIAL_RX_RING_SIZE];
+static volatile uint32_t rx_in = 0, rx_out = 0;
+
+// Arrival time of each batch the interrupt moved, so the consumer can tell
+// when a byte really arrived rather than when it was read
+#define RX_STAMPS 16
+static struct {
+    uint32_t end;           // rx_in after the batch
+    uint32_t us;
+} rx_stamps[RX_STAMPS];
+static volatile uint32_t stamp_in = 0;
+static uint32_t stamp_out = 0;
+
+static volatile bool throttled = false;     // XOFF sent / RTS deasserted
+static volatile bool xoff_pending = false;
+static uint32_t credit_granted = 0;         // total bytes the host may send
+
+static volatile uint32_t stat_overruns = 0, stat_dropped = 0;
+
+static inline uint32_t ring_used() {
+    return rx_in - rx_out;
+}
+
+static void __not_in_flash_func(serial_rx_irq)(void) {
+    uart_hw_t *hw = uart_get_hw(uart0);
+    uint32_t in = rx_in;
+    if (hw->ris & UART_UARTRIS_OERIS_BITS) {
+        stat_overruns++;
+        hw->icr = UART_UARTICR_OEIC_BITS;
+    }
+    while (uart_is_readable(uart0)) {
+        uint8_t data = uart_getc(uart0);
+        if (in - rx_out >= SERIAL_RX_RING_SIZE) {
+            stat_dropped++;
+            continue;
+        }
+        rx_ring[in & (SERIAL_RX_RING_SIZE - 1)] = data;
+        in++;
+    }
+    rx_stamps[stamp_in % RX_STAMPS].end = in;
+    rx_stamps[stamp_in % RX_STAMPS].us = timer_hw->timerawl;
+    stamp_in++;
+    rx_in = in;
+
+    // Throttle the sender as soon as we cross the high watermark
+    if (!throttled && in - rx_out >= SERIAL_HIGH_WATER) {
+        if (serial_flow_mode == FLOW_XONXOFF) {
+            throttled = true;
+            if (uart_is_writable(uart0)) {
+                uart_putc_raw(uart0, SERIAL_XOFF);
+            } else {
+                xoff_pending = true;
+            }
+        } else if (serial_flow_mode == FLOW_RTSCTS) {
+            throttled = true;
+            gpio_put(SERIAL_RTS_PIN, 1);
+        }
+    }
+}
+
+// Raise the RX interrupt threshold at high rates: a byte arrives every
+// 3.3us at 3 Mbaud, so interrupting at 1/2 full (16 bytes) instead of
+// 1/8 keeps the interrupt rate sane while still leaving 16 bytes of
+// FIFO for the time the handler waits behind the vsync interrupt.
+static void set_rx_threshold(uint32_t baud) {
+    uint level = (baud >= 460800) ? 2 : 0;
+    hw_write_masked(&uart_get_hw(uart0)->ifls, level << UART_UARTIFLS_RXIFLSEL_LSB,
+                    UART_UARTIFLS_RXIFLSEL_BITS);
+}
+
+void serial_rx_init() {
+    irq_set_exclusive_handler(UART0_IRQ, serial_rx_irq);
+    irq_set_enabled(UART0_IRQ, true);
+    uart_set_irq_enables(uart0, true, false);
+    set_rx_threshold(current_baud);
+}
+
+// Longest contiguous run of received bytes that arrived in one interrupt
+// batch (so they share an arrival time). Returns 0 if the ring is empty.
+static uint32_t peek_out;
+
+size_t serial_rx_peek(const uint8_t **data, uint32_t *arrival_us) {
+    uint32_t out = rx_out;
+    uint32_t in = rx_in;
+    if (out == in) return 0;
+
+    // Skip the stamps of batches already consumed (or overwritten)
+    if (stamp_in - stamp_out > RX_STAMPS) stamp_out = stamp_in - RX_STAMPS;
+    while (stamp_out != stamp_in && (int32_t)(rx_stamps[stamp_out % RX_STAMPS].end - out) <= 0) {
+        stamp_out++;
+    }
+    uint32_t end = in;
+    if (stamp_out != stamp_in) {
+        *arrival_us = rx_stamps[stamp_out % RX_STAMPS].us;
+        if ((int32_t)(rx_stamps[stamp_out % RX_STAMPS].end - end) < 0) end = rx_stamps[stamp_out % RX_STAMPS].end;
+    } else {
+        *arrival_us = time_us_32();
+    }
+
+    // Stop at the end of the ring storage
+    uint32_t index = out & (SERIAL_RX_RING_SIZE - 1);
+    if (end - out > SERIAL_RX_RING_SIZE - index) end = out + SERIAL_RX_RING_SIZE - index;
+
+    peek_out = out;
+    *data = &rx_ring[index];
+    return end - out;
+}
+
+void serial_rx_release(size_t n) {
+    // Ignore the release if the ring was flushed while the run was parsed
+    // (auto-baud discards everything received at the old rate)
+    if (rx_out == peek_out) rx_out = peek_out + n;
+}
+
+// Flow control housekeeping, called from the main loop
+void serial_rx_service() {
+    if (xoff_pending && uart_is_writable(uart0)) {
+        xoff_pending = false;
+        uart_putc_raw(uart0, SERIAL_XOFF);
+    }
+    if (throttled && ring_used() <= SERIAL_LOW_WATER) {
+        throttled = false;
+        if (serial_flow_mode == FLOW_XONXOFF) {
+            uart_putc_raw(uart0, SERIAL_XON);
+        } else if (serial_flow_mode == FLOW_RTSCTS) {
+            gpio_put(SERIAL_RTS_PIN, 0);
+        }
+    }
+    if (serial_flow_mode == FLOW_CREDIT) {
+        // Grant whatever the ring can hold beyond what is already promised,
+        // in batches so grants do not flood the return channel
+        uint32_t in = rx_in;
+        uint32_t outstanding = (int32_t)(credit_granted - in) > 0 ? credit_granted - in : 0;
+        uint32_t available = SERIAL_RX_RING_SIZE - ring_used() - outstanding;
+        if (available >= SERIAL_RX_RING_SIZE / 8) {
+            uint32_t units = available / SERIAL_CREDIT_UNIT;
+            if (units > 255) units = 255;
+            uart_putc_raw(uart0, SERIAL_CREDIT_TOKEN);
+            uart_putc_raw(uart0, (char)units);
+            credit_granted = ((int32_t)(credit_granted - in) > 0 ? credit_granted : in) + units * SERIAL_CREDIT_UNIT;
+        }
+    }
+}
+
+void serial_set_flow_mode(enum flow_modes mode) {
+    // Release whatever the previous mode was holding back
+    if (serial_flow_mode == FLOW_XONXOFF && throttled) {
+        uart_putc_raw(uart0, SERIAL_XON);
+    }
+    if (serial_flow_mode == FLOW_RTSCTS) {
+        uart_set_hw_flow(uart0, false, false);
+        gpio_set_function(SERIAL_CTS_PIN, GPIO_FUNC_SIO);
+        gpio_put(SERIAL_RTS_PIN, 0);
+    }
+    throttled = false;
+    xoff_pending = false;
+
+    if (mode == FLOW_RTSCTS) {
+        gpio_set_function(SERIAL_CTS_PIN, GPIO_FUNC_UART);
+        gpio_init(SERIAL_RTS_PIN);
+        gpio_set_dir(SERIAL_RTS_PIN, GPIO_OUT);
+        gpio_put(SERIAL_RTS_PIN, 0);
+        uart_set_hw_flow(uart0, true, false);
+    } else if (mode == FLOW_CREDIT) {
+        credit_granted = rx_in;     // the host starts with no credit
+    }
+    serial_flow_mode = mode;
+}
+
+void serial_rx_report() {
+    static const char *names[] = { "none", "xonxoff", "rtscts", "credit" };
+    uint32_t in = rx_in;
+    printf("\nFlow: %s used=%lu/%d received=%lu overruns=%lu dropped=%lu credit=%ld\n",
+           names[serial_flow_mode], (unsigned long)ring_used(), SERIAL_RX_RING_SIZE,
+           (unsigned long)in, (unsigned long)stat_overruns, (unsigned long)stat_dropped,
+           serial_flow_mode == FLOW_CREDIT ? (long)(int32_t)(credit_granted - in) : 0L);
+}
+
+// Baud rate the PL011 actually produces for a requested rate, using the
+// same divisor rounding as uart_set_baudrate()
+static uint32_t achieved_baud(uint32_t clk, uint32_t baud) {
+    uint32_t div = (8 * clk / baud) + 1;
+    uint32_t ibrd = div >> 7;
+    uint32_t fbrd;
+    if (ibrd == 0) {
+        ibrd = 1;
+        fbrd = 0;
+    } else if (ibrd >= 65535) {
+        ibrd = 65535;
+        fbrd = 0;
+    } else {
+        fbrd = (div & 0x7f) >> 1;
+    }
+    return (4 * (uint64_t)clk) / (64 * ibrd + fbrd);
+}
+
+// Switch the line rate once everything queued for sending has gone out.
+// Returns the rate actually achieved.
+uint32_t serial_set_baud(uint32_t baud) {
+    uart_tx_wait_blocking(uart0);
+    current_baud = uart_set_baudrate(uart0, baud);
+    set_rx_threshold(current_baud);
+    return current_baud;
+}
+
+// Cycles between the first and fifth falling edge on the RX pin. A stream
+// of 0x55 bytes is a square wave (start bit 0, data bits 1010..., stop bit 1),
+// so five falling edges are exactly 8 bit times apart. Runs from RAM with
+// interrupts off, polling the pin against SysTick; returns 0 on timeout.
+static uint32_t __not_in_flash_func(measure_sync)(void) {
+    const uint32_t mask = 1u << SERIAL_RX_PIN;
+    uint32_t start = 0;
+    for (int edge = 0; edge < 5; edge++) {
+        uint32_t spins = 1u << 20;
+        while (!(sio_hw->gpio_in & mask)) if (--spins == 0) return 0;
+        while (sio_hw->gpio_in & mask) if (--spins == 0) return 0;
+        if (edge == 0) start = systick_hw->cvr;
+    }
+    return (start - systick_hw->cvr) & 0xffffff;   // SysTick counts down
+}
+
+// Wait for the host to send sync bytes at its new rate and switch to the
+// nearest supported rate. Returns the new rate, or 0 if nothing usable
+// arrived before the timeout (the old rate is kept).
+uint32_t serial_autobaud(uint32_t timeout_us) {
+    uint32_t clk = clock_get_hz(clk_sys);
+    uint32_t best_cycles = 0xffffffff;
+
+    uart_tx_wait_blocking(uart0);
+    systick_hw->rvr = 0xffffff;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;      // enable, count processor clocks
+    gpio_set_function(SERIAL_RX_PIN, GPIO_FUNC_SIO);
+    gpio_set_dir(SERIAL_RX_PIN, GPIO_IN);
+
+    // Keep the shortest of several measurements: a gap between bytes only
+    // ever makes a measurement longer
+    uint32_t start_us = time_us_32();
+    int samples = 0;
+    while (samples < 8 && time_us_32() - start_us < timeout_us) {
+        uint32_t status = save_and_disable_interrupts();
+        uint32_t cycles = measure_sync();
+        restore_interrupts(status);
+        if (cycles == 0) continue;
+        if (cycles < best_cycles) best_cycles = cycles;
+        samples++;
+    }
+    gpio_set_function(SERIAL_RX_PIN, GPIO_FUNC_UART);
+    if (samples == 0) return 0;
+
+    uint32_t measured = (uint32_t)((8 * (uint64_t)clk) / best_cycles);
+    uint32_t best = 0, best_diff = 0xffffffff;
+    for (int i = 0; i < serial_baud_count; i++) {
+        uint32_t rate = serial_baud_rates[i];
+        uint32_t diff = measured > rate ? measured - rate : rate - measured;
+        if (diff < best_diff) {
+            best_diff = diff;
+            best = rate;
+        }
+    }
+    if (best_diff > best / 20) return 0;    // more than 5% from any rate
+
+    // Discard the sync bytes the UART picked up at the old rate
+    serial_set_baud(best);
+    while (uart_is_readable(uart0)) (void)uart_getc(uart0);
+    rx_out = rx_in;
+    return current_baud;
+}
+
+// Current rate, then the divisor error of every supported rate at the
+// configured clk_peri
+void serial_baud_report() {
+    uint32_t clk = clock_get_hz(clk_peri);
+    printf("\nBaud: %lu (clk_peri %lu Hz)\n", (unsigned long)current_baud, (unsigned long)clk);
+    for (int i = 0; i < serial_baud_count; i++) {
+        uint32_t rate = serial_baud_rates[i];
+        uint32_t actual = achieved_baud(clk, rate);
+        int32_t error_ppm = (int32_t)(((int64_t)actual - rate) * 1000000 / rate);
+        int32_t magnitude = error_ppm < 0 ? -error_ppm : error_ppm;
+        printf("%8lu -> %8lu  %c%ld.%02ld%%\n", (unsigned long)rate, (unsigned long)actual,
+               error_ppm < 0 ? '-' : '+', (long)(magnitude / 10000), (long)(magnitude % 10000 / 100));
+    }
+}
@@ -0,0 +1,65 @@
+/**
+ * Interrupt-driven UART receive ring with flow control
+ *
+ * The UART RX interrupt moves bytes from the 32-byte hardware FIFO into a
+ * larger ring, so slow commands no longer overrun the line. The ring's
+ * free space is advertised to the host in one of three ways:
+ *
+ *   FLOW_XONXOFF  XOFF (0x13) above the high watermark, XON (0x11) once
+ *                 the ring has drained below the low watermark
+ *   FLOW_RTSCTS   RTS (GPIO 3, active low) follows the same watermarks;
+ *                 CTS (GPIO 2) gates our own transmitter
+ *   FLOW_CREDIT   explicit credits: the firmware sends ACK (0x06) followed
+ *                 by a count n, allowing the host n * SERIAL_CREDIT_UNIT
+ *                 more bytes. A host that never exceeds its credit can keep
+ *                 the pipe full without ever losing data.
+ *
+ * The line starts at SERIAL_DEFAULT_BAUD. /BAUD switches to any rate in
+ * serial_baud_rates (up to 3 Mbaud), either explicitly or by timing a
+ * stream of sync bytes (0x55) sent by the host at the new rate.
+ */
+
+#ifndef SERIAL_RX_H
+#define SERIAL_RX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Receive ring size (power of two)
+#ifndef SERIAL_RX_RING_SIZE
+#define SERIAL_RX_RING_SIZE 4096
+#endif
+
+#define SERIAL_HIGH_WATER   (SERIAL_RX_RING_SIZE * 3 / 4)
+#define SERIAL_LOW_WATER    (SERIAL_RX_RING_SIZE / 4)
+
+#define SERIAL_CREDIT_UNIT  64
+#define SERIAL_CREDIT_TOKEN 0x06
+#define SERIAL_XON          0x11
+#define SERIAL_XOFF         0x13
+
+#define SERIAL_DEFAULT_BAUD 115200
+#define SERIAL_SYNC_BYTE    0x55
+
+#define SERIAL_RX_PIN  1
+#define SERIAL_CTS_PIN 2
+#define SERIAL_RTS_PIN 3
+
+enum flow_modes { FLOW_NONE, FLOW_XONXOFF, FLOW_RTSCTS, FLOW_CREDIT } ;
+
+extern enum flow_modes serial_flow_mode ;
+extern const uint32_t serial_baud_rates[] ;
+extern const int serial_baud_count ;
+
+void serial_rx_init(void) ;
+size_t serial_rx_peek(const uint8_t **data, uint32_t *arrival_us) ;
+void serial_rx_release(size_t n) ;
+void serial_rx_service(void) ;
+void serial_set_flow_mode(enum flow_modes mode) ;
+void serial_rx_report(void) ;
+uint32_t serial_set_baud(uint32_t baud) ;
+uint32_t serial_autobaud(uint32_t timeout_us) ;
+void serial_baud_report(void) ;
+
+#endif
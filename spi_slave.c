@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/spi.h"
+#include "spi_slave.h"
+#include "dma_ring.h"
+#include "transport.h"
+
+bool spi_slave_enabled = false;
+
+static uint8_t spi_buf[SPI_RING_SIZE] __attribute__((aligned(SPI_RING_SIZE)));
+static DmaRing spi_ring;
+static bool spi_loaded = false;
+static uint32_t stat_overruns = 0;
+
+// READY follows the ring's free space; checked on every poll of the
+// transport and from the DMA interrupt after every SPI_MAX_FRAME bytes
+static void update_ready() {
+    if (spi_get_hw(spi0)->ris & SPI_SSPRIS_RORRIS_BITS) {
+        stat_overruns++;
+        spi_get_hw(spi0)->icr = SPI_SSPICR_RORIC_BITS;
+    }
+    gpio_put(SPI_READY_PIN, SPI_RING_SIZE - dma_ring_used(&spi_ring) >= SPI_READY_SPACE);
+}
+
+void spi_slave_enable(bool enable) {
+    if (enable == spi_slave_enabled) return;
+    if (!spi_loaded) {
+        gpio_init(SPI_READY_PIN);
+        gpio_set_dir(SPI_READY_PIN, GPIO_OUT);
+        gpio_put(SPI_READY_PIN, 0);
+        dma_ring_init(&spi_ring, spi_buf, SPI_RING_BITS, SPI_MAX_FRAME, &spi_get_hw(spi0)->dr,
+                      spi_get_dreq(spi0, false));
+        spi_ring.notify = update_ready;
+        spi_loaded = true;
+    }
+    if (enable) {
+        // The baud rate only matters in master mode
+        spi_init(spi0, 1000000);
+        spi_set_slave(spi0, true);
+        spi_set_format(spi0, 8, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
+        gpio_set_function(SPI_RX_PIN, GPIO_FUNC_SPI);
+        gpio_set_function(SPI_CS_PIN, GPIO_FUNC_SPI);
+        gpio_set_function(SPI_SCK_PIN, GPIO_FUNC_SPI);
+        dma_ring_start(&spi_ring);
+        update_ready();
+    } else {
+        gpio_put(SPI_READY_PIN, 0);
+        spi_deinit(spi0);
+        dma_ring_stop(&spi_ring);
+    }
+    spi_slave_enabled = enable;
+}
+
+static size_t spi_receive(const uint8_t **data, uint32_t *arrival_us) {
+    if (!spi_slave_enabled) return 0;
+    update_ready();
+    *arrival_us = time_us_32();
+    return dma_ring_peek(&spi_ring, data);
+}
+
+static void spi_release(size_t n) {
+    dma_ring_release(&spi_ring, n);
+    update_ready();
+}
+
+// Receive only; replies go out on the UART
+static void spi_write(const char *data, size_t len) {
+    uart_transport.write(data, len);
+}
+
+const Transport spi_transport = {
+    "spi", spi_receive, spi_release, spi_write
+};
+
+void spi_slave_report() {
+    if (!spi_loaded) {
+        printf("\nSPI: off\n");
+        return;
+    }
+    printf("\nSPI: %s received=%lu used=%lu/%u full=%lu overruns=%lu\n",
+           spi_slave_enabled ? "on" : "off", (unsigned long)dma_ring_received(&spi_ring),
+           (unsigned long)dma_ring_used(&spi_ring), SPI_RING_SIZE,
+           (unsigned long)spi_ring.full_count, (unsigned long)stat_overruns);
+}
@@ -0,0 +1,40 @@
+/**
+ * SPI slave command input
+ *
+ * For hosts with SPI but no fast UART. spi0 runs as a slave in SPI mode 3
+ * (CPOL=1, CPHA=1, so /CS may stay low for a whole frame) and a DMA channel
+ * moves received bytes into a receive ring (see dma_ring.h). The bytes use
+ * the same framing as the UART: console text, /commands, escape sequences
+ * and STX/ETX transactions.
+ *
+ * A slave cannot stall the master's clock, so READY tells the host when it
+ * may send: it is high while the ring has room for SPI_READY_SPACE bytes.
+ * The DMA interrupt re-arms the channel and updates READY every
+ * SPI_MAX_FRAME bytes, so READY is at most a frame stale even while the
+ * main loop is busy drawing. A host that checks READY before each frame of
+ * at most SPI_MAX_FRAME bytes never overruns the ring.
+ *
+ * The link is receive only: replies go out on the UART.
+ */
+
+#ifndef SPI_SLAVE_H
+#define SPI_SLAVE_H
+
+#include <stdbool.h>
+
+#define SPI_RX_PIN    4     // host MOSI
+#define SPI_CS_PIN    5
+#define SPI_SCK_PIN   22
+#define SPI_READY_PIN 26
+
+#define SPI_RING_BITS   12
+#define SPI_RING_SIZE   (1u << SPI_RING_BITS)
+#define SPI_MAX_FRAME   256
+#define SPI_READY_SPACE (4 * SPI_MAX_FRAME)
+
+extern bool spi_slave_enabled ;
+
+void spi_slave_enable(bool enable) ;
+void spi_slave_report(void) ;
+
+#endif
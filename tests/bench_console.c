@@ -0,0 +1,104 @@
+// Console throughput: the whole firmware, fed a generated log dump (the
+// one tools/logbench.py makes) through the injection transport at about
+// 2 kB per frame, once with /CONSOLE IMMEDIATE and once BATCHED. Each mode
+// runs in a child process so it starts from a fresh console and counters.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "pico/stdlib.h"
+#include "vga16_graphics.h"
+#include "cmdqueue.h"
+#include "transport.h"
+
+#define LOG_BYTES 200000
+#define BYTES_PER_FRAME 2048
+
+void execute_units(const QueueEntry *units, int count);
+void init_console();
+void init_screen_buffer();
+void init_virtual_consoles();
+void handle_serial_input();
+void console_report();
+
+static char log_text[LOG_BYTES + 256];
+static int log_len;
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void generate_log() {
+    for (int i = 0; log_len < LOG_BYTES; i++) {
+        log_len += sprintf(log_text + log_len,
+                           "2024-05-01 12:%02d:%02d.%03d INFO worker[%d] processed request id=%d status=ok\n",
+                           i / 60 % 60, i % 60, i % 1000, i % 8, i);
+    }
+}
+
+// Hand one chunk to the firmware and let it run until it is consumed
+static void feed(const char *data, int len) {
+    transport_inject((const uint8_t *)data, len);
+    handle_serial_input();
+}
+
+// One frame: the vsync interrupt's count, 16.7ms of time, a service pass
+static void frame() {
+    vga_frame_count++;
+    vga_frame_end_us = timer_hw->timerawl;
+    timer_hw->timerawl += 16667;
+    handle_serial_input();
+}
+
+static void run(const char *mode) {
+    // The echo of the input goes to stdout; drop it during the run
+    fflush(stdout);
+    int saved = dup(1);
+    freopen("/dev/null", "w", stdout);
+    cmdqueue_init(execute_units);
+    initVGA();
+    init_console();
+    init_screen_buffer();
+    init_virtual_consoles();
+    char command[32];
+    snprintf(command, sizeof(command), "/CONSOLE %s\n", mode);
+    feed(command, strlen(command));
+    frame();
+
+    double start = now_s();
+    for (int at = 0; at < log_len; at += BYTES_PER_FRAME) {
+        feed(log_text + at, log_len - at < BYTES_PER_FRAME ? log_len - at : BYTES_PER_FRAME);
+        frame();
+    }
+    frame();
+    double seconds = now_s() - start;
+    fflush(stdout);
+    dup2(saved, 1);
+    printf("%-9s %8.1f kB/s", mode, log_len / seconds / 1e3);
+    fflush(stdout);
+    console_report();
+}
+
+int main() {
+    generate_log();
+    printf("%d bytes, %d per frame\n", log_len, BYTES_PER_FRAME);
+    const char *modes[] = { "IMMEDIATE", "BATCHED" };
+    for (int i = 0; i < 2; i++) {
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0) {
+            run(modes[i]);
+            fflush(stdout);
+            _exit(0);
+        }
+        int status;
+        waitpid(child, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return 1;
+    }
+    return 0;
+}
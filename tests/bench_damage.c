@@ -0,0 +1,72 @@
+// Cost of the damage tracker in the drawing primitives. Built twice by the
+// Makefile: with VGA_DAMAGE_TRACKING=0 (compiled out) and =1, where each
+// primitive is timed with tracking off and on.
+
+#include <stdio.h>
+#include <time.h>
+#include "pico/stdlib.h"
+#include "vga16_graphics.h"
+
+#define ROUNDS 200
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void pixels() {
+    for (int y = 0; y < 480; y += 2)
+        for (int x = 0; x < 640; x += 8) drawPixel(x, y, (x + y) & 15);
+}
+
+static void lines() {
+    for (int i = 0; i < 200; i++) drawLine(i, 0, 639 - i, 479, i & 15);
+}
+
+static void rects() {
+    for (int i = 0; i < 100; i++) fillRect(i * 3, i * 2, 200, 150, i & 15);
+}
+
+static void text() {
+    for (int y = 0; y < 480; y += 8)
+        for (int x = 0; x < 636; x += 6) drawChar(x, y, 'A' + (x / 6) % 26, 15, 1, 1);
+}
+
+static void scroll() {
+    for (int i = 0; i < 20; i++) vga_move_rows(0, 16, 464);
+}
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} cases[] = {
+    { "drawPixel", pixels }, { "drawLine", lines }, { "fillRect", rects },
+    { "drawChar", text }, { "vga_move_rows", scroll },
+};
+
+static double time_case(void (*run)(void)) {
+    double start = now_s();
+    for (int r = 0; r < ROUNDS; r++) {
+        run();
+#if VGA_DAMAGE_TRACKING
+        vga_damage_clear();
+#endif
+    }
+    return (now_s() - start) / ROUNDS * 1e6;
+}
+
+int main() {
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+#if VGA_DAMAGE_TRACKING
+        vga_damage_enable(false);
+        double off = time_case(cases[i].run);
+        vga_damage_enable(true);
+        double on = time_case(cases[i].run);
+        printf("%-14s tracking off %8.1f us  on %8.1f us  (%+.0f%%)\n", cases[i].name, off, on, (on / off - 1) * 100);
+#else
+        printf("%-14s compiled out %8.1f us\n", cases[i].name, time_case(cases[i].run));
+#endif
+    }
+    return 0;
+}
@@ -0,0 +1,282 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pio_sim.h"
+
+enum { OP_JMP, OP_WAIT, OP_IN, OP_OUT, OP_PUSH_PULL, OP_MOV, OP_IRQ, OP_SET };
+
+typedef struct {
+    char name[32];
+    int pc;
+} Label;
+
+static int fail(const char *path, int line, const char *what) {
+    fprintf(stderr, "%s:%d: %s\n", path, line, what);
+    return 0;
+}
+
+// Words of a line, lower-cased, with commas and brackets as separators
+static int split(char *line, char *words[], int max) {
+    int n = 0;
+    for (char *p = line; *p; p++) {
+        if (*p == ',') *p = ' ';
+        *p = tolower((unsigned char)*p);
+    }
+    for (char *w = strtok(line, " \t\r\n"); w && n < max; w = strtok(NULL, " \t\r\n")) {
+        words[n++] = w;
+    }
+    return n;
+}
+
+static int source_code(const char *word) {
+    static const char *names[] = { "pins", "x", "y", "null", "", "", "isr", "osr" };
+    for (int i = 0; i < 8; i++) {
+        if (names[i][0] && strcmp(word, names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+bool pio_assemble(const char *path, PioProgram *program) {
+    FILE *f = fopen(path, "r");
+    if (!f) return fail(path, 0, "cannot open");
+    memset(program, 0, sizeof(*program));
+    program->wrap = -1;
+    Label labels[PIO_MAX_PROGRAM];
+    int label_count = 0;
+    char lines[PIO_MAX_PROGRAM][256];
+    int line_numbers[PIO_MAX_PROGRAM];
+    char raw[256];
+    int number = 0;
+    bool in_sdk_block = false;
+
+    // First pass: directives and labels; instruction lines are kept
+    while (fgets(raw, sizeof(raw), f)) {
+        number++;
+        if (strncmp(raw, "% ", 2) == 0) in_sdk_block = true;
+        if (strncmp(raw, "%}", 2) == 0) { in_sdk_block = false; continue; }
+        if (in_sdk_block) continue;
+        char *comment = strpbrk(raw, ";");
+        if (comment) *comment = '\0';
+        char *p = raw;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0') continue;
+        if (*p == '.') {
+            char *words[4];
+            int n = split(p, words, 4);
+            if (strcmp(words[0], ".program") == 0) continue;
+            if (strcmp(words[0], ".wrap_target") == 0) { program->wrap_target = program->length; continue; }
+            if (strcmp(words[0], ".wrap") == 0) { program->wrap = program->length - 1; continue; }
+            if (strcmp(words[0], ".side_set") == 0 && n >= 2) {
+                program->side_set_count = atoi(words[1]);
+                program->side_set_optional = n >= 3 && strcmp(words[2], "opt") == 0;
+                continue;
+            }
+            fclose(f);
+            return fail(path, number, "unsupported directive");
+        }
+        char *colon = strchr(p, ':');
+        if (colon) {
+            *colon = '\0';
+            snprintf(labels[label_count].name, sizeof(labels[0].name), "%.31s", p);
+            labels[label_count++].pc = program->length;
+            p = colon + 1;
+            while (isspace((unsigned char)*p)) p++;
+            if (*p == '\0') continue;
+        }
+        if (program->length == PIO_MAX_PROGRAM) { fclose(f); return fail(path, number, "program too long"); }
+        snprintf(lines[program->length], sizeof(lines[0]), "%s", p);
+        line_numbers[program->length++] = number;
+    }
+    fclose(f);
+    if (program->wrap < 0) program->wrap = program->length - 1;
+
+    // Second pass: encode
+    int delay_bits = 5 - program->side_set_count - (program->side_set_optional ? 1 : 0);
+    for (int pc = 0; pc < program->length; pc++) {
+        char text[256], *words[12];
+        snprintf(text, sizeof(text), "%s", lines[pc]);
+        // Pull out "[delay]" first
+        int delay = 0;
+        char *bracket = strchr(text, '[');
+        if (bracket) {
+            delay = atoi(bracket + 1);
+            *bracket = '\0';
+        }
+        int n = split(text, words, 12);
+        int side = -1;
+        for (int i = 0; i < n; i++) {
+            if (strcmp(words[i], "side") == 0 && i + 1 < n) {
+                side = atoi(words[i + 1]);
+                n = i;
+                break;
+            }
+        }
+        int line = line_numbers[pc];
+        if (delay >= (1 << delay_bits)) return fail(path, line, "delay too long");
+        if (side < 0 && program->side_set_count && !program->side_set_optional) return fail(path, line, "side-set missing");
+        int ds = delay;
+        if (side >= 0) {
+            int side_field = side;
+            if (program->side_set_optional) side_field |= 1 << program->side_set_count;
+            ds |= side_field << delay_bits;
+        }
+        uint16_t word;
+        const char *op = words[0];
+        if (strcmp(op, "nop") == 0) {
+            word = (OP_MOV << 13) | (2 << 5) | 2;       // mov y, y
+        } else if (strcmp(op, "wait") == 0 && n == 4) {
+            int src = strcmp(words[2], "gpio") == 0 ? 0 : strcmp(words[2], "pin") == 0 ? 1 : -1;
+            if (src < 0) return fail(path, line, "unsupported wait source");
+            word = (OP_WAIT << 13) | (atoi(words[1]) << 7) | (src << 5) | atoi(words[3]);
+        } else if (strcmp(op, "in") == 0 && n == 3) {
+            int src = source_code(words[1]);
+            if (src < 0) return fail(path, line, "bad in source");
+            word = (OP_IN << 13) | (src << 5) | (atoi(words[2]) & 31);
+        } else if (strcmp(op, "push") == 0) {
+            bool iffull = false, block = true;
+            for (int i = 1; i < n; i++) {
+                if (strcmp(words[i], "iffull") == 0) iffull = true;
+                else if (strcmp(words[i], "noblock") == 0) block = false;
+            }
+            word = (OP_PUSH_PULL << 13) | (iffull << 6) | (block << 5);
+        } else if (strcmp(op, "set") == 0 && n == 3) {
+            int dest = strcmp(words[1], "pins") == 0 ? 0 : strcmp(words[1], "x") == 0 ? 1 : strcmp(words[1], "y") == 0 ? 2 : -1;
+            if (dest < 0) return fail(path, line, "bad set destination");
+            word = (OP_SET << 13) | (dest << 5) | (atoi(words[2]) & 31);
+        } else if (strcmp(op, "jmp") == 0 && (n == 2 || n == 3)) {
+            static const char *conds[] = { "", "!x", "x--", "!y", "y--", "x!=y", "pin", "!osre" };
+            int cond = 0;
+            if (n == 3) {
+                for (cond = 1; cond < 8 && strcmp(words[1], conds[cond]) != 0; cond++) {}
+                if (cond == 8) return fail(path, line, "bad jmp condition");
+            }
+            int target = -1;
+            for (int i = 0; i < label_count; i++) {
+                if (strcmp(labels[i].name, words[n - 1]) == 0) target = labels[i].pc;
+            }
+            if (target < 0) return fail(path, line, "unknown label");
+            word = (OP_JMP << 13) | (cond << 5) | target;
+        } else {
+            return fail(path, line, "unsupported instruction");
+        }
+        program->code[pc] = word | (ds << 8);
+    }
+    return true;
+}
+
+void pio_sm_init_sim(PioSm *sm, const PioProgram *program, int in_base, bool in_shift_right, int side_set_base) {
+    memset(sm, 0, sizeof(*sm));
+    sm->program = program;
+    sm->in_base = in_base;
+    sm->in_shift_right = in_shift_right;
+    sm->side_set_base = side_set_base;
+    sm->pc = program->wrap_target;
+}
+
+bool pio_sm_pop(PioSm *sm, uint32_t *value) {
+    if (sm->fifo_count == 0) return false;
+    *value = sm->fifo[0];
+    memmove(&sm->fifo[0], &sm->fifo[1], --sm->fifo_count * sizeof(uint32_t));
+    return true;
+}
+
+static void shift_in(PioSm *sm, uint32_t data, int bits) {
+    uint32_t mask = bits == 32 ? 0xffffffffu : (1u << bits) - 1;
+    data &= mask;
+    if (sm->in_shift_right) {
+        sm->isr = (bits == 32) ? data : (sm->isr >> bits) | (data << (32 - bits));
+    } else {
+        sm->isr = (bits == 32) ? data : (sm->isr << bits) | data;
+    }
+    sm->isr_count += bits;
+    if (sm->isr_count > 32) sm->isr_count = 32;
+}
+
+static void advance(PioSm *sm) {
+    if (sm->pc == sm->program->wrap) sm->pc = sm->program->wrap_target;
+    else sm->pc = (sm->pc + 1) % sm->program->length;
+}
+
+void pio_sm_step(PioSm *sm, uint32_t gpio_in) {
+    const PioProgram *p = sm->program;
+    sm->cycles++;
+    if (sm->delay > 0) {
+        sm->delay--;
+        return;
+    }
+    uint16_t word = p->code[sm->pc];
+    int delay_bits = 5 - p->side_set_count - (p->side_set_optional ? 1 : 0);
+    int ds = (word >> 8) & 31;
+    int delay = ds & ((1 << delay_bits) - 1);
+    int side = ds >> delay_bits;
+    bool side_enabled = p->side_set_count && (!p->side_set_optional || (side >> p->side_set_count));
+    if (side_enabled) {
+        // Side-set takes effect when the instruction starts, stalled or not
+        uint32_t mask = ((1u << p->side_set_count) - 1) << sm->side_set_base;
+        side &= (1 << p->side_set_count) - 1;
+        sm->side_pins = (sm->side_pins & ~mask) | ((uint32_t)side << sm->side_set_base);
+    }
+
+    uint32_t in_pins = (gpio_in >> sm->in_base) | (sm->in_base ? gpio_in << (32 - sm->in_base) : 0);
+    bool jumped = false;
+    sm->stalled = false;
+    switch (word >> 13) {
+    case OP_JMP: {
+        int cond = (word >> 5) & 7, target = word & 31;
+        bool take = cond == 0 || (cond == 1 && sm->x == 0) || (cond == 2 && sm->x-- != 0) ||
+                    (cond == 3 && sm->y == 0) || (cond == 4 && sm->y-- != 0) || (cond == 5 && sm->x != sm->y);
+        if (take) {
+            sm->pc = target;
+            jumped = true;
+        }
+        break;
+    }
+    case OP_WAIT: {
+        int polarity = (word >> 7) & 1, src = (word >> 5) & 3, index = word & 31;
+        int level = src == 0 ? (gpio_in >> index) & 1 : (in_pins >> index) & 1;
+        if (level != polarity) sm->stalled = true;
+        break;
+    }
+    case OP_IN: {
+        int src = (word >> 5) & 7, bits = word & 31 ? word & 31 : 32;
+        uint32_t data = src == 0 ? in_pins : src == 1 ? sm->x : src == 2 ? sm->y : src == 6 ? sm->isr : 0;
+        shift_in(sm, data, bits);
+        break;
+    }
+    case OP_PUSH_PULL: {
+        bool pull = (word >> 7) & 1, iffull = (word >> 6) & 1, block = (word >> 5) & 1;
+        if (pull) { fprintf(stderr, "pull not simulated\n"); abort(); }
+        if (iffull && sm->isr_count < 32) break;
+        if (sm->fifo_count == PIO_RX_FIFO) {
+            if (block) {
+                sm->stalled = true;
+                break;
+            }
+        } else {
+            sm->fifo[sm->fifo_count++] = sm->isr;
+        }
+        sm->isr = 0;
+        sm->isr_count = 0;
+        break;
+    }
+    case OP_MOV: {
+        int dest = (word >> 5) & 7, op = (word >> 3) & 3, src = word & 7;
+        uint32_t v = src == 0 ? in_pins : src == 1 ? sm->x : src == 2 ? sm->y : src == 6 ? sm->isr : 0;
+        if (op == 1) v = ~v;
+        if (dest == 1) sm->x = v; else if (dest == 2) sm->y = v; else if (dest == 6) { sm->isr = v; sm->isr_count = 0; }
+        break;
+    }
+    case OP_SET: {
+        int dest = (word >> 5) & 7, data = word & 31;
+        if (dest == 1) sm->x = data; else if (dest == 2) sm->y = data;
+        break;
+    }
+    default:
+        fprintf(stderr, "instruction %04x not simulated\n", word);
+        abort();
+    }
+    if (sm->stalled) return;        // retried next cycle, delay not yet applied
+    sm->delay = delay;
+    if (!jumped) advance(sm);
+}
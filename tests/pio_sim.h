@@ -0,0 +1,54 @@
+/**
+ * PIO assembler and instruction-level simulator for the host tests
+ *
+ * pio_assemble() reads a .pio source (one program, the instructions and
+ * directives the firmware's programs use) into RP2040 instruction words;
+ * PioSm then runs those words one clock cycle at a time against a 32-bit
+ * GPIO input word, with side-set, delays, stalls, wrap, the input shift
+ * register and a (joined, 8-entry) RX FIFO.
+ */
+
+#ifndef PIO_SIM_H
+#define PIO_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PIO_MAX_PROGRAM 32
+#define PIO_RX_FIFO 8
+
+typedef struct {
+    uint16_t code[PIO_MAX_PROGRAM];
+    int length;
+    int wrap_target, wrap;      // default: the whole program
+    int side_set_count;         // bits of side-set (excluding the enable bit)
+    bool side_set_optional;
+} PioProgram;
+
+typedef struct {
+    const PioProgram *program;
+    // Configuration (what the c-sdk init function sets up)
+    int in_base;                // GPIO that is IN pin 0
+    bool in_shift_right;
+    int side_set_base;
+    // State
+    int pc;
+    int delay;                  // cycles of delay left
+    uint32_t isr, x, y;
+    int isr_count;
+    uint32_t fifo[PIO_RX_FIFO];
+    int fifo_count;
+    uint32_t side_pins;         // GPIO levels driven by side-set
+    bool stalled;
+    uint64_t cycles;
+} PioSm;
+
+// Returns false (with a message on stderr) on a syntax error
+bool pio_assemble(const char *path, PioProgram *program);
+void pio_sm_init_sim(PioSm *sm, const PioProgram *program, int in_base, bool in_shift_right, int side_set_base);
+// One clock cycle with the GPIO inputs at gpio_in
+void pio_sm_step(PioSm *sm, uint32_t gpio_in);
+// Take the oldest RX FIFO entry (as the DMA would); false if empty
+bool pio_sm_pop(PioSm *sm, uint32_t *value);
+
+#endif
@@ -0,0 +1,5 @@
+// Host stand-in for the header pioasm generates from hsync.pio
+#pragma once
+#include "hardware/pio.h"
+static const pio_program_t hsync_program = { 0 };
+static inline void hsync_program_init(PIO pio, uint sm, uint offset, uint pin) { (void)pio; (void)sm; (void)offset; (void)pin; }
@@ -0,0 +1,8 @@
+// Host stand-in for the header pioasm generates from parallel.pio (the
+// program itself is run by tests/test_parallel_pio.c from the .pio source)
+#pragma once
+#include "hardware/pio.h"
+static const pio_program_t parallel_in_program = { 0 };
+static inline void parallel_in_program_init(PIO pio, uint sm, uint offset, uint data_pin, uint busy_pin) {
+    (void)pio; (void)sm; (void)offset; (void)data_pin; (void)busy_pin;
+}
@@ -0,0 +1,70 @@
+#include <string.h>
+#include "pico_host.h"
+
+static timer_hw_t timer_block;
+timer_hw_t *timer_hw = &timer_block;
+static sio_hw_t sio_block;
+sio_hw_t *sio_hw = &sio_block;
+static systick_hw_t systick_block;
+systick_hw_t *systick_hw = &systick_block;
+static dma_hw_t dma_block;
+dma_hw_t *dma_hw = &dma_block;
+uart_hw_t uart_host_hw[2] = { { .fr = UART_UARTFR_RXFE_BITS }, { .fr = UART_UARTFR_RXFE_BITS } };
+pio_hw_t pio_host_hw[2];
+spi_hw_t spi_host_hw[2];
+uint32_t gpio_out_state;
+irq_handler_t irq_host_handlers[32];
+
+static struct {
+    uint8_t data[UART_HOST_FIFO];
+    int head, level;
+} uart_fifo[2];
+
+bool uart_host_receive(uart_inst_t *uart, uint8_t byte) {
+    uart_hw_t *hw = uart_get_hw(uart);
+    int n = hw - uart_host_hw;
+    if (uart_fifo[n].level == UART_HOST_FIFO) {
+        hw->ris |= UART_UARTRIS_OERIS_BITS;
+        return false;
+    }
+    uart_fifo[n].data[(uart_fifo[n].head + uart_fifo[n].level++) % UART_HOST_FIFO] = byte;
+    hw->fr &= ~UART_UARTFR_RXFE_BITS;
+    return true;
+}
+
+int uart_host_rx_level(uart_inst_t *uart) {
+    return uart_fifo[uart_get_hw(uart) - uart_host_hw].level;
+}
+
+bool uart_is_readable(uart_inst_t *uart) {
+    return uart_host_rx_level(uart) > 0;
+}
+
+char uart_getc(uart_inst_t *uart) {
+    uart_hw_t *hw = uart_get_hw(uart);
+    int n = hw - uart_host_hw;
+    if (uart_fifo[n].level == 0) return 0;
+    uint8_t byte = uart_fifo[n].data[uart_fifo[n].head];
+    uart_fifo[n].head = (uart_fifo[n].head + 1) % UART_HOST_FIFO;
+    if (--uart_fifo[n].level == 0) hw->fr |= UART_UARTFR_RXFE_BITS;
+    return (char)byte;
+}
+
+static void usb_out_chars(const char *buf, int len) { (void)buf; (void)len; }
+static int usb_in_chars(char *buf, int len) { (void)buf; (void)len; return 0; }
+stdio_driver_t stdio_usb = { usb_out_chars, usb_in_chars };
+
+void sleep_ms(uint32_t ms) {
+    timer_block.timerawl += ms * 1000;
+}
+
+// UART output is dropped; a test that wants it can define its own
+__attribute__((weak)) void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len) {
+    (void)uart; (void)src; (void)len;
+}
+
+int dma_claim_unused_channel(bool required) {
+    static int next = 0;
+    (void)required;
+    return next < 12 ? next++ : -1;
+}
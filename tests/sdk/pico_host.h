@@ -0,0 +1,225 @@
+/**
+ * Host stand-in for the parts of the Pico SDK the firmware uses
+ *
+ * Enough of the SDK for the firmware sources to compile and run on a PC in
+ * the host tests: the hardware register blocks are plain structs in memory
+ * (a test can set a DMA transfer count or a timer value directly), and the
+ * SDK calls that configure hardware do nothing. time_us_32() reads
+ * timer_hw->timerawl, which the tests advance themselves.
+ */
+
+#ifndef PICO_HOST_H
+#define PICO_HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+typedef unsigned int uint;
+typedef volatile uint32_t io_rw_32;
+typedef volatile uint32_t io_ro_32;
+typedef volatile uint32_t io_wo_32;
+
+#define __not_in_flash_func(f) f
+#define __time_critical_func(f) f
+
+// Timer
+typedef struct {
+    io_ro_32 timerawl, timerawh;
+} timer_hw_t;
+extern timer_hw_t *timer_hw;
+static inline uint32_t time_us_32(void) { return timer_hw->timerawl; }
+static inline uint64_t time_us_64(void) { return timer_hw->timerawl; }
+void sleep_ms(uint32_t ms);
+
+// Clocks
+enum clock_index { clk_gpout0, clk_ref, clk_sys, clk_peri };
+static inline uint32_t clock_get_hz(enum clock_index clk) { (void)clk; return 125000000; }
+
+// Interrupts
+#define UART0_IRQ 20
+#define DMA_IRQ_0 11
+#define DMA_IRQ_1 12
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+// Handlers are recorded so a test can raise an interrupt by calling them
+typedef void (*irq_handler_t)(void);
+extern irq_handler_t irq_host_handlers[32];
+static inline void irq_set_exclusive_handler(uint num, irq_handler_t handler) { irq_host_handlers[num] = handler; }
+// Sharing is not modelled: the last handler added is the one recorded
+static inline void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority) {
+    (void)order_priority; irq_host_handlers[num] = handler;
+}
+static inline void irq_set_enabled(uint num, bool enabled) { (void)num; (void)enabled; }
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t status) { (void)status; }
+static inline uint get_core_num(void) { return 0; }
+static inline void hw_write_masked(io_rw_32 *addr, uint32_t values, uint32_t mask) {
+    *addr = (*addr & ~mask) | (values & mask);
+}
+
+// GPIO
+enum gpio_function { GPIO_FUNC_SPI = 1, GPIO_FUNC_UART = 2, GPIO_FUNC_PIO0 = 6, GPIO_FUNC_PIO1 = 7, GPIO_FUNC_SIO = 5 };
+#define GPIO_IN  false
+#define GPIO_OUT true
+typedef struct {
+    io_ro_32 cpuid;
+    io_ro_32 gpio_in;
+} sio_hw_t;
+extern sio_hw_t *sio_hw;
+extern uint32_t gpio_out_state;
+static inline void gpio_init(uint gpio) { (void)gpio; }
+static inline void gpio_set_function(uint gpio, enum gpio_function fn) { (void)gpio; (void)fn; }
+static inline void gpio_set_dir(uint gpio, bool out) { (void)gpio; (void)out; }
+static inline void gpio_pull_up(uint gpio) { (void)gpio; }
+static inline void gpio_put(uint gpio, bool value) {
+    if (value) gpio_out_state |= 1u << gpio; else gpio_out_state &= ~(1u << gpio);
+}
+static inline bool gpio_get(uint gpio) { return (sio_hw->gpio_in >> gpio) & 1; }
+
+// SysTick
+typedef struct {
+    io_rw_32 csr, rvr, cvr;
+    io_ro_32 calib;
+} systick_hw_t;
+extern systick_hw_t *systick_hw;
+
+// UART
+typedef struct {
+    io_rw_32 dr, rsr, _pad0[4];
+    io_ro_32 fr;
+    io_rw_32 _pad1, ilpr, ibrd, fbrd, lcr_h, cr, ifls, imsc, ris, mis, icr, dmacr;
+} uart_hw_t;
+typedef struct uart_inst uart_inst_t;
+extern uart_hw_t uart_host_hw[2];
+#define uart0 ((uart_inst_t *)&uart_host_hw[0])
+#define uart1 ((uart_inst_t *)&uart_host_hw[1])
+#define UART_UARTFR_RXFE_BITS 0x10
+#define UART_UARTDR_OE_BITS 0x800
+#define UART_UARTIFLS_RXIFLSEL_LSB 3
+#define UART_UARTIFLS_RXIFLSEL_BITS 0x38
+static inline uart_hw_t *uart_get_hw(uart_inst_t *uart) { return (uart_hw_t *)uart; }
+static inline uint uart_init(uart_inst_t *uart, uint baud) { (void)uart; return baud; }
+static inline uint uart_set_baudrate(uart_inst_t *uart, uint baud) { (void)uart; return baud; }
+static inline void uart_set_hw_flow(uart_inst_t *uart, bool cts, bool rts) { (void)uart; (void)cts; (void)rts; }
+static inline void uart_set_irq_enables(uart_inst_t *uart, bool rx, bool tx) { (void)uart; (void)rx; (void)tx; }
+#define UART_UARTRIS_OERIS_BITS 0x400
+#define UART_UARTICR_OEIC_BITS 0x400
+#define UART_HOST_FIFO 32
+// RX FIFO model: a test delivers bytes with uart_host_receive() (false, and
+// the overrun flag set in RIS, if the 32-byte FIFO was full); the firmware
+// reads them with uart_is_readable() and uart_getc()
+bool uart_host_receive(uart_inst_t *uart, uint8_t byte);
+int uart_host_rx_level(uart_inst_t *uart);
+bool uart_is_readable(uart_inst_t *uart);
+static inline bool uart_is_writable(uart_inst_t *uart) { (void)uart; return true; }
+static inline void uart_tx_wait_blocking(uart_inst_t *uart) { (void)uart; }
+char uart_getc(uart_inst_t *uart);
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len);
+static inline void uart_putc_raw(uart_inst_t *uart, char c) { uart_write_blocking(uart, (const uint8_t *)&c, 1); }
+static inline void uart_putc(uart_inst_t *uart, char c) { uart_putc_raw(uart, c); }
+static inline void uart_puts(uart_inst_t *uart, const char *s) { while (*s) uart_putc(uart, *s++); }
+
+// stdio
+static inline bool stdio_uart_init_full(uart_inst_t *uart, uint baud, int tx, int rx) {
+    (void)uart; (void)baud; (void)tx; (void)rx; return true;
+}
+typedef struct {
+    void (*out_chars)(const char *buf, int len);
+    int (*in_chars)(char *buf, int len);
+} stdio_driver_t;
+extern stdio_driver_t stdio_usb;
+static inline bool stdio_usb_connected(void) { return false; }
+
+// DMA
+typedef struct {
+    io_rw_32 read_addr, write_addr, transfer_count, ctrl_trig;
+    io_rw_32 _aliases[12];
+} dma_channel_hw_t;
+typedef struct {
+    dma_channel_hw_t ch[12];
+    io_rw_32 intr, inte0, intf0, ints0;
+    uint32_t _pad1;
+    io_rw_32 inte1, intf1, ints1;
+} dma_hw_t;
+extern dma_hw_t *dma_hw;
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+#define DREQ_PIO0_TX2 2
+typedef struct { uint32_t ctrl; } dma_channel_config;
+int dma_claim_unused_channel(bool required);
+static inline dma_channel_config dma_channel_get_default_config(uint channel) {
+    (void)channel; dma_channel_config c = { 0 }; return c;
+}
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) { (void)c; (void)size; }
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) { (void)c; (void)incr; }
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) { (void)c; (void)incr; }
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) { (void)c; (void)dreq; }
+static inline void channel_config_set_chain_to(dma_channel_config *c, uint chan) { (void)c; (void)chan; }
+static inline void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) { (void)c; (void)write; (void)size_bits; }
+static inline void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                                         const volatile void *read_addr, uint transfer_count, bool trigger) {
+    (void)config; (void)trigger;
+    dma_hw->ch[channel].write_addr = (uint32_t)(uintptr_t)write_addr;
+    dma_hw->ch[channel].read_addr = (uint32_t)(uintptr_t)read_addr;
+    dma_hw->ch[channel].transfer_count = transfer_count;
+}
+static inline void dma_channel_set_trans_count(uint channel, uint32_t count, bool trigger) {
+    (void)trigger; dma_hw->ch[channel].transfer_count = count;
+}
+static inline void dma_channel_set_write_addr(uint channel, volatile void *addr, bool trigger) {
+    (void)trigger; dma_hw->ch[channel].write_addr = (uint32_t)(uintptr_t)addr;
+}
+static inline void dma_channel_set_irq0_enabled(uint channel, bool enabled) { (void)channel; (void)enabled; }
+static inline void dma_channel_set_irq1_enabled(uint channel, bool enabled) { (void)channel; (void)enabled; }
+static inline void dma_start_channel_mask(uint32_t mask) { (void)mask; }
+static inline void dma_channel_abort(uint channel) { (void)channel; }
+// A channel runs until its count is used up; tests move the count themselves
+static inline bool dma_channel_is_busy(uint channel) { return dma_hw->ch[channel].transfer_count != 0; }
+
+// PIO
+typedef struct {
+    io_rw_32 ctrl, fstat, fdebug, flevel;
+    io_wo_32 txf[4];
+    io_ro_32 rxf[4];
+} pio_hw_t;
+typedef pio_hw_t *PIO;
+extern pio_hw_t pio_host_hw[2];
+#define pio0 (&pio_host_hw[0])
+#define pio1 (&pio_host_hw[1])
+typedef struct {
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+typedef struct { uint32_t clkdiv, execctrl, shiftctrl, pinctrl; } pio_sm_config;
+static inline uint pio_add_program(PIO pio, const pio_program_t *program) { (void)pio; (void)program; return 0; }
+static inline int pio_claim_unused_sm(PIO pio, bool required) { (void)pio; (void)required; return 0; }
+static inline void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) { (void)pio; (void)sm; (void)enabled; }
+static inline void pio_sm_clear_fifos(PIO pio, uint sm) { (void)pio; (void)sm; }
+static inline void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data) { pio->txf[sm] = data; }
+static inline void pio_enable_sm_mask_in_sync(PIO pio, uint32_t mask) { (void)pio; (void)mask; }
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx) { (void)pio; (void)sm; (void)is_tx; return 0; }
+
+// SPI
+typedef struct {
+    io_rw_32 cr0, cr1, dr, sr, cpsr, imsc, ris, mis, icr, dmacr;
+} spi_hw_t;
+typedef struct spi_inst spi_inst_t;
+extern spi_hw_t spi_host_hw[2];
+#define spi0 ((spi_inst_t *)&spi_host_hw[0])
+#define spi1 ((spi_inst_t *)&spi_host_hw[1])
+typedef enum { SPI_CPOL_0, SPI_CPOL_1 } spi_cpol_t;
+typedef enum { SPI_CPHA_0, SPI_CPHA_1 } spi_cpha_t;
+typedef enum { SPI_LSB_FIRST, SPI_MSB_FIRST } spi_order_t;
+#define SPI_SSPRIS_RORRIS_BITS 0x1
+#define SPI_SSPICR_RORIC_BITS 0x1
+static inline spi_hw_t *spi_get_hw(spi_inst_t *spi) { return (spi_hw_t *)spi; }
+static inline uint spi_init(spi_inst_t *spi, uint baud) { (void)spi; return baud; }
+static inline void spi_deinit(spi_inst_t *spi) { (void)spi; }
+static inline void spi_set_slave(spi_inst_t *spi, bool slave) { (void)spi; (void)slave; }
+static inline void spi_set_format(spi_inst_t *spi, uint bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order) {
+    (void)spi; (void)bits; (void)cpol; (void)cpha; (void)order;
+}
+static inline uint spi_get_dreq(spi_inst_t *spi, bool is_tx) { (void)spi; (void)is_tx; return 0; }
+
+#endif
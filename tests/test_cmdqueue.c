@@ -0,0 +1,112 @@
+// Command queue: whatever is submitted comes out of the executor in the
+// same order and intact, however the ring wraps and the drain is cut by the
+// frame budget, including records that end exactly at the end of the ring.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "cmdqueue.h"
+
+volatile uint32_t vga_frame_count, vga_frame_end_us;
+
+static char expected[1 << 20], executed[1 << 20];
+static int expected_len, executed_len;
+static int failures;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+// Commands are logged bracketed, text as is, so coalesced runs of text log
+// the same as the separate submissions
+static void log_unit(char *log, int *len, uint8_t kind, const char *data, int n) {
+    if (kind != QUEUE_TEXT) log[(*len)++] = '[';
+    memcpy(log + *len, data, n);
+    *len += n;
+    if (kind != QUEUE_TEXT) log[(*len)++] = ']';
+}
+
+// Each unit takes 100us, so a drain window runs budget / 100 of them
+static void executor(const QueueEntry *units, int count) {
+    for (int i = 0; i < count; i++) {
+        CHECK(units[i].data[units[i].len] == '\0', "unit not terminated");
+        CHECK((int)strlen(units[i].data) == units[i].len, "length %d, text %d", units[i].len, (int)strlen(units[i].data));
+        log_unit(executed, &executed_len, units[i].kind, units[i].data, units[i].len);
+        timer_hw->timerawl += 100;
+    }
+}
+
+static void submit(uint8_t kind, const char *data, int n) {
+    log_unit(expected, &expected_len, kind, data, n);
+    cmdqueue_submit(kind, data, n, timer_hw->timerawl);
+}
+
+// Start a frame and drain what fits in the budget
+static void frame() {
+    vga_frame_count++;
+    vga_frame_end_us = timer_hw->timerawl;
+    cmdqueue_service();
+}
+
+static void check_logs(const char *what) {
+    cmdqueue_flush();
+    CHECK(executed_len == expected_len && memcmp(executed, expected, expected_len) == 0,
+          "%s: executed %d bytes, expected %d", what, executed_len, expected_len);
+    expected_len = executed_len = 0;
+}
+
+// Fill the ring so the tail lands exactly on its end, free the head, then
+// wrap: text that follows must not grow over records still queued
+static void test_wrap_at_end() {
+    char buf[CMDQUEUE_BYTES];
+    // Records are 8 + len + 1 bytes rounded up to 4: len 1015 makes 1024
+    memset(buf, 'c', sizeof(buf));
+    for (int i = 0; i < CMDQUEUE_BYTES / 1024; i++) {
+        buf[0] = 'A' + i;
+        submit(QUEUE_COMMAND, buf, 1015);
+    }
+    cmdqueue_budget_us = 100;
+    frame();                                // runs the first record only
+    submit(QUEUE_TEXT, "wrapped", 7);       // wraps to offset 0
+    for (int i = 0; i < 100; i++) {
+        submit(QUEUE_TEXT, "0123456789", 10);
+    }
+    check_logs("wrap at end");
+}
+
+static void test_random() {
+    srand(1);
+    char buf[600];
+    for (int round = 0; round < 20000; round++) {
+        int r = rand() % 10;
+        if (r < 7) {
+            int n = 1 + rand() % ((rand() % 8) ? 40 : 600);
+            for (int i = 0; i < n; i++) buf[i] = 'a' + rand() % 26;
+            submit((rand() % 3) ? QUEUE_TEXT : QUEUE_COMMAND, buf, n);
+        } else {
+            cmdqueue_budget_us = 100 * (1 + rand() % 6);
+            frame();
+        }
+    }
+    check_logs("random");
+}
+
+// An entry larger than the whole ring still runs, in order
+static void test_oversized() {
+    static char big[CMDQUEUE_BYTES + 100];
+    memset(big, 'x', sizeof(big) - 1);
+    submit(QUEUE_COMMAND, "before", 6);
+    submit(QUEUE_TEXT, "text", 4);
+    submit(QUEUE_COMMAND, big, sizeof(big) - 1);
+    submit(QUEUE_COMMAND, "after", 5);
+    check_logs("oversized entry");
+}
+
+int main() {
+    cmdqueue_init(executor);
+    cmdqueue_deferred = true;
+    test_wrap_at_end();
+    test_oversized();
+    test_random();
+    printf("cmdqueue: %s\n", failures ? "FAILED" : "ok");
+    return failures != 0;
+}
@@ -0,0 +1,71 @@
+// Damage tracking: after each primitive, with random and partly off-screen
+// coordinates, every framebuffer byte that changed lies inside the damage
+// recorded for its row.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "vga16_graphics.h"
+
+extern unsigned char vga_data_array[];
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static unsigned char before[640 * 480 / 2];
+
+static short coord(int range) {
+    return rand() % (range + 200) - 100;
+}
+
+static void primitive(int kind) {
+    short x = coord(640), y = coord(480), x1 = coord(640), y1 = coord(480);
+    short w = rand() % 200 - 20, h = rand() % 200 - 20, r = rand() % 100;
+    char color = rand() % 16, bg = rand() % 16;
+    switch (kind) {
+    case 0: drawPixel(x, y, color); break;
+    case 1: drawLine(x, y, x1, y1, color); break;
+    case 2: drawHLine(x, y, w, color); break;
+    case 3: drawVLine(x, y, h, color); break;
+    case 4: drawRect(x, y, w, h, color); break;
+    case 5: fillRect(x, y, w, h, color); break;
+    case 6: drawCircle(x, y, r, color); break;
+    case 7: fillCircle(x, y, r, color); break;
+    case 8: drawRoundRect(x, y, w, h, r / 4, color); break;
+    case 9: fillRoundRect(x, y, w, h, r / 4, color); break;
+    case 10: drawChar(x, y, 'A' + rand() % 26, color, bg, 1 + rand() % 3); break;
+    case 11: drawCharBig(x | 1, y, 'a' + rand() % 26, color, bg); break;
+    }
+}
+
+int main() {
+    srand(1);
+    vga_damage_enable(true);
+    for (int round = 0; round < 3000 && failures < 5; round++) {
+        int kind = round % 12;
+        memcpy(before, vga_data_array, sizeof(before));
+        vga_damage_clear();
+        primitive(kind);
+        for (int y = 0; y < 480; y++) {
+            short x0 = 640, x1 = -1;
+            vga_damage_row(y, &x0, &x1);
+            for (int b = y * 320; b < (y + 1) * 320; b++) {
+                if (vga_data_array[b] == before[b]) continue;
+                int px = (b - y * 320) * 2;
+                if (px + 1 < x0 || px > x1) {
+                    CHECK(0, "round %d, primitive %d: pixels %d-%d of row %d changed outside %d-%d",
+                          round, kind, px, px + 1, y, x0, x1);
+                    break;
+                }
+            }
+        }
+    }
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("damage: ok\n");
+    return 0;
+}
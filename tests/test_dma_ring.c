@@ -0,0 +1,194 @@
+// DMA receive ring: a model of the channel writes into the ring as far as
+// its transfer count allows and raises the completion interrupt when the
+// count runs out, and everything comes out of peek/release in order, across
+// the end of the storage and across the 32-bit wrap of the byte counters,
+// with the ring filling up when nothing is released.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "dma_ring.h"
+
+#define BITS 6
+#define SIZE (1u << BITS)
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static uint8_t buf[SIZE] __attribute__((aligned(SIZE)));
+static DmaRing ring;
+static uint8_t next_in, next_out;   // the byte sequence sent and expected
+static int notified;
+
+static void notify() {
+    notified++;
+}
+
+// The channel: up to n bytes from the FIFO, stopping when its count runs
+// out and the interrupt leaves it idle. Writes wrap on the ring like the
+// hardware's ring feature.
+static int deliver(int n) {
+    int done = 0;
+    while (done < n && dma_hw->ch[ring.chan].transfer_count) {
+        buf[dma_ring_received(&ring) & (SIZE - 1)] = next_in++;
+        if (--dma_hw->ch[ring.chan].transfer_count == 0) {
+            dma_hw->ints1 |= 1u << ring.chan;
+            irq_host_handlers[DMA_IRQ_1]();
+            dma_hw->ints1 = 0;
+        }
+        done++;
+    }
+    return done;
+}
+
+// Take up to n bytes, checking them against the sequence
+static int consume(int n) {
+    int done = 0;
+    const uint8_t *data;
+    size_t len;
+    while (done < n && (len = dma_ring_peek(&ring, &data)) > 0) {
+        if (len > (size_t)(n - done)) len = n - done;
+        CHECK(data >= buf && data + len <= buf + SIZE, "run of %d outside the storage", (int)len);
+        for (size_t i = 0; i < len; i++) {
+            if (data[i] != next_out) {
+                CHECK(0, "byte %02x, expected %02x", data[i], next_out);
+                return done;
+            }
+            next_out++;
+        }
+        dma_ring_release(&ring, len);
+        done += len;
+    }
+    return done;
+}
+
+static void start(uint32_t chunk) {
+    memset(&dma_hw->ch[0], 0, sizeof(dma_hw->ch));
+    ring.chunk = chunk;
+    dma_ring_start(&ring);
+    next_in = next_out = 0;
+    notified = 0;
+}
+
+static void test_basic() {
+    start(SIZE);
+    const uint8_t *data;
+    CHECK(dma_ring_peek(&ring, &data) == 0, "peek on an empty ring");
+    CHECK(dma_hw->ch[ring.chan].transfer_count == SIZE, "armed for %u", (unsigned)dma_hw->ch[ring.chan].transfer_count);
+    deliver(10);
+    CHECK(dma_ring_received(&ring) == 10 && dma_ring_used(&ring) == 10, "received %u used %u",
+          (unsigned)dma_ring_received(&ring), (unsigned)dma_ring_used(&ring));
+    CHECK(dma_ring_peek(&ring, &data) == 10 && data == buf, "peek");
+    CHECK(consume(4) == 4, "consume");
+    CHECK(dma_ring_used(&ring) == 6, "used %u after release", (unsigned)dma_ring_used(&ring));
+    // Still running on its first allowance: releasing must not re-arm it
+    CHECK(dma_hw->ch[ring.chan].transfer_count == SIZE - 10, "re-armed while busy");
+}
+
+// Received bytes that straddle the end of the storage come out as two runs
+static void test_wrap() {
+    start(SIZE);
+    deliver(SIZE - 3);
+    consume(SIZE - 3);
+    deliver(3);         // the first allowance is used up here
+    CHECK(dma_hw->ch[ring.chan].transfer_count == SIZE - 3, "re-armed for %u, expected the free space",
+          (unsigned)dma_hw->ch[ring.chan].transfer_count);
+    const uint8_t *data;
+    CHECK(dma_ring_peek(&ring, &data) == 3 && data == buf + SIZE - 3, "run up to the end");
+    deliver(5);
+    CHECK(dma_ring_peek(&ring, &data) == 3, "run stops at the end of the storage");
+    consume(3);
+    CHECK(dma_ring_peek(&ring, &data) == 5 && data == buf, "run continues at the start");
+    CHECK(consume(5) == 5 && dma_ring_used(&ring) == 0, "drained");
+}
+
+// Nothing released: the ring fills, the channel is left idle and the full
+// count goes up once per episode
+static void test_full() {
+    start(SIZE);
+    CHECK(deliver(SIZE + 10) == SIZE, "channel wrote past the free space");
+    CHECK(ring.full && ring.full_count == 1, "interrupt did not find the ring full");
+    const uint8_t *data;
+    dma_ring_peek(&ring, &data);
+    dma_ring_peek(&ring, &data);
+    CHECK(ring.full && ring.full_count == 1, "full %d count %u", ring.full, (unsigned)ring.full_count);
+    CHECK(dma_ring_used(&ring) == SIZE, "used %u", (unsigned)dma_ring_used(&ring));
+    CHECK(consume(7) == 7, "consume");
+    CHECK(!ring.full && dma_hw->ch[ring.chan].transfer_count == 7, "re-armed for %u after release",
+          (unsigned)dma_hw->ch[ring.chan].transfer_count);
+    CHECK(deliver(100) == 7, "channel wrote past the free space");
+    dma_ring_peek(&ring, &data);
+    CHECK(ring.full_count == 2, "full count %u", (unsigned)ring.full_count);
+    CHECK(consume(1000) == SIZE, "drained");
+}
+
+// Space released while the channel runs is handed to it by the interrupt
+// when its allowance runs out, without waiting for another peek or release
+static void test_irq_rearm() {
+    start(SIZE);
+    deliver(SIZE / 2);
+    CHECK(consume(SIZE / 2) == SIZE / 2, "consume");
+    CHECK(deliver(SIZE) == SIZE, "channel stopped at the end of its first allowance");
+    CHECK(dma_ring_used(&ring) == SIZE && ring.full, "used %u", (unsigned)dma_ring_used(&ring));
+    CHECK(consume(SIZE) == SIZE, "drained");
+}
+
+// Armed a chunk at a time: the channel keeps going chunk after chunk on its
+// own, and notify runs after each one
+static void test_chunks() {
+    start(SIZE / 4);
+    CHECK(dma_hw->ch[ring.chan].transfer_count == SIZE / 4, "armed for %u", (unsigned)dma_hw->ch[ring.chan].transfer_count);
+    CHECK(deliver(SIZE / 4 + 1) == SIZE / 4 + 1, "channel stopped after a chunk");
+    CHECK(notified == 1 && dma_hw->ch[ring.chan].transfer_count == SIZE / 4 - 1, "notified %d, armed for %u",
+          notified, (unsigned)dma_hw->ch[ring.chan].transfer_count);
+    CHECK(deliver(2 * SIZE) == SIZE - SIZE / 4 - 1, "channel wrote past the free space");
+    CHECK(notified == 4 && ring.full, "notified %d full %d", notified, ring.full);
+    consume(SIZE / 2);
+    CHECK(dma_hw->ch[ring.chan].transfer_count == SIZE / 4, "re-armed for %u after release",
+          (unsigned)dma_hw->ch[ring.chan].transfer_count);
+    CHECK(consume(1000) == SIZE / 2, "drained");
+}
+
+// Random arrival and consumption, from a fresh start and with the byte
+// counters about to wrap around 2^32
+static void test_random(uint32_t counter_start, uint32_t chunk) {
+    start(chunk);
+    dma_ring_stop(&ring);
+    ring.out = ring.armed = counter_start;
+    dma_hw->ch[ring.chan].transfer_count = 0;
+    dma_ring_release(&ring, 0);     // arms the channel at the new position
+    long sent = 0, taken = 0;
+    for (int round = 0; round < 200000 && !failures; round++) {
+        sent += deliver(rand() % (2 * SIZE));
+        taken += consume(rand() % (2 * SIZE));
+        CHECK(dma_ring_used(&ring) <= SIZE, "used %u", (unsigned)dma_ring_used(&ring));
+        CHECK(sent - taken == (long)dma_ring_used(&ring), "used %u, in flight %ld", (unsigned)dma_ring_used(&ring), sent - taken);
+    }
+    taken += consume(SIZE);
+    CHECK(sent == taken, "sent %ld, took %ld", sent, taken);
+    CHECK(ring.out - counter_start == (uint32_t)taken, "byte count %u", (unsigned)(ring.out - counter_start));
+}
+
+int main() {
+    srand(1);
+    dma_ring_init(&ring, buf, BITS, SIZE, NULL, 0);
+    ring.notify = notify;
+    test_basic();
+    test_wrap();
+    test_full();
+    test_irq_rearm();
+    test_chunks();
+    test_random(0, SIZE);
+    test_random(0xffffffffu - 1000, SIZE);
+    test_random(0, 7);
+    test_random(0xffffffffu - 1000, 7);
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("dma ring: ok\n");
+    return 0;
+}
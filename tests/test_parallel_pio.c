@@ -0,0 +1,168 @@
+// Parallel bus PIO program: parallel.pio assembled and run on the PIO
+// simulator against a model of the host's bus. Checks when the byte is
+// latched, the BUSY handshake, one byte per strobe, and that a full FIFO
+// holds the host off without losing anything.
+
+#include <stdio.h>
+#include <string.h>
+#include "pio_sim.h"
+#include "parallel.h"
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static PioProgram program;
+static PioSm sm;
+static uint32_t data_bus;       // D0-D7 as driven by the host
+static bool strobe_low;
+
+static uint32_t gpio_in() {
+    uint32_t gpio = data_bus << PARALLEL_D0_PIN;
+    if (!strobe_low) gpio |= 1u << PARALLEL_STROBE_PIN;     // pulled up when idle
+    return gpio;
+}
+
+static bool busy() {
+    return (sm.side_pins >> PARALLEL_BUSY_PIN) & 1;
+}
+
+static void run(int cycles) {
+    for (int i = 0; i < cycles; i++) pio_sm_step(&sm, gpio_in());
+}
+
+static void reset() {
+    pio_sm_init_sim(&sm, &program, PARALLEL_D0_PIN, false, PARALLEL_BUSY_PIN);
+    data_bus = 0;
+    strobe_low = false;
+    run(4);
+}
+
+// Run until BUSY reaches level; false if it doesn't within limit cycles
+static bool wait_busy(bool level, int limit) {
+    for (int i = 0; i < limit; i++) {
+        if (busy() == level) return true;
+        run(1);
+    }
+    return busy() == level;
+}
+
+// One write the way a host does it: wait for BUSY low, then a strobe of
+// fixed width (200ns at 125MHz) with the data valid throughout
+#define STROBE_CYCLES 25
+
+static bool host_write(uint8_t byte) {
+    if (!wait_busy(false, 1000)) return false;
+    data_bus = byte;
+    strobe_low = true;
+    run(STROBE_CYCLES);
+    bool seen = busy();
+    strobe_low = false;
+    data_bus = 0xff;            // the bus floats once the strobe is over
+    return seen;
+}
+
+// The byte is taken after the settle delay, not when the strobe falls
+static void test_latch() {
+    reset();
+    data_bus = 0x00;
+    strobe_low = true;
+    run(1);                     // wait sees the strobe
+    run(4);
+    data_bus = 0x5a;            // still settling
+    run(5);                     // settle over, in pins executes
+    data_bus = 0xc3;            // changes after the latch are ignored
+    run(10);
+    strobe_low = false;
+    run(10);
+    uint32_t value;
+    CHECK(pio_sm_pop(&sm, &value) && value == 0x5a, "latched %02x, expected 5a", value);
+    CHECK(!pio_sm_pop(&sm, &value), "extra FIFO entry");
+}
+
+// BUSY: low while idle, up as soon as the strobe is seen, down once it ends
+static void test_busy() {
+    reset();
+    run(50);
+    CHECK(!busy(), "BUSY high while idle");
+    data_bus = 0x41;
+    strobe_low = true;
+    run(1);
+    CHECK(!busy(), "BUSY high before the strobe was seen");
+    run(1);
+    CHECK(busy(), "BUSY not raised the cycle after the strobe");
+    run(200);
+    CHECK(busy(), "BUSY dropped while the strobe is still low");
+    strobe_low = false;
+    CHECK(wait_busy(false, 3), "BUSY still high after the strobe ended");
+}
+
+// A long strobe is still one byte
+static void test_one_byte_per_strobe() {
+    reset();
+    data_bus = 0x7e;
+    strobe_low = true;
+    run(500);
+    strobe_low = false;
+    run(50);
+    CHECK(sm.fifo_count == 1, "%d FIFO entries for one strobe", sm.fifo_count);
+}
+
+// A stream with the DMA draining the FIFO arrives in order
+static void test_stream() {
+    reset();
+    uint8_t received[256];
+    int count = 0;
+    for (int i = 0; i < 256; i++) {
+        CHECK(host_write(i), "byte %d: no BUSY handshake", i);
+        uint32_t value;
+        while (pio_sm_pop(&sm, &value)) received[count++] = value;
+    }
+    run(20);
+    uint32_t value;
+    while (pio_sm_pop(&sm, &value)) received[count++] = value;
+    CHECK(count == 256, "received %d bytes", count);
+    for (int i = 0; i < count; i++) {
+        if (received[i] != i) {
+            CHECK(0, "byte %d arrived as %02x", i, received[i]);
+            break;
+        }
+    }
+}
+
+// With nothing draining, the ninth byte blocks in push and BUSY holds the
+// host off until an entry is taken
+static void test_fifo_full() {
+    reset();
+    for (int i = 0; i < PIO_RX_FIFO; i++) CHECK(host_write(0x10 + i), "byte %d: no BUSY handshake", i);
+    CHECK(wait_busy(false, 10), "BUSY high with a full FIFO but no pending byte");
+    CHECK(host_write(0x99), "ninth byte: no BUSY handshake");
+    run(1000);
+    CHECK(busy(), "BUSY dropped while push is blocked");
+    CHECK(sm.fifo_count == PIO_RX_FIFO, "FIFO holds %d", sm.fifo_count);
+
+    uint32_t value;
+    pio_sm_pop(&sm, &value);
+    CHECK(value == 0x10, "first entry %02x", value);
+    CHECK(wait_busy(false, 10), "BUSY still high after the FIFO was drained");
+    for (int i = 1; i < PIO_RX_FIFO; i++) {
+        CHECK(pio_sm_pop(&sm, &value) && value == 0x10u + i, "entry %d is %02x", i, value);
+    }
+    CHECK(pio_sm_pop(&sm, &value) && value == 0x99, "blocked byte arrived as %02x", value);
+    CHECK(!pio_sm_pop(&sm, &value), "extra FIFO entry");
+}
+
+int main() {
+    if (!pio_assemble("../parallel.pio", &program)) return 1;
+    test_latch();
+    test_busy();
+    test_one_byte_per_strobe();
+    test_stream();
+    test_fifo_full();
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("parallel PIO: ok\n");
+    return 0;
+}
@@ -0,0 +1,145 @@
+// UART receive flow control at full offered load: a host model keeps the
+// 32-byte UART FIFO as full as the flow control mode lets it while the
+// main loop stalls now and then for a slow command. Checks the XOFF/XON
+// and RTS thresholds, that credit grants never promise more than the ring
+// can hold, and that every byte arrives, in order, with no FIFO overrun.
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+#include "serial_rx.h"
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+#define STREAM_BYTES 300000
+#define BYTES_PER_TICK 8        // offered load: more than the main loop takes on average
+#define XOFF_LAG 16             // bytes the host still sends after an XOFF (its own FIFO)
+
+// Host side
+static uint32_t sent, taken;    // bytes into the UART FIFO, bytes the parser consumed
+static bool stopped;            // XOFF received, or CTS (our RTS) deasserted
+static int lag;
+static uint32_t credit;         // bytes the host may still send
+static bool expect_count;       // the next byte from the firmware is a credit count
+static int xoffs, xons, grants;
+static const char *mode_name;
+static bool lost;               // a byte went missing or arrived out of order
+
+static uint32_t used() {
+    return sent - uart_host_rx_level(uart0) - taken;
+}
+
+// What the firmware sends back
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = src[i];
+        if (serial_flow_mode == FLOW_CREDIT) {
+            if (expect_count) {
+                expect_count = false;
+                credit += c * SERIAL_CREDIT_UNIT;
+                grants++;
+                // Promised plus held never exceeds the ring
+                CHECK(credit + used() + uart_host_rx_level(uart0) <= SERIAL_RX_RING_SIZE,
+                      "%s: credit %u with %u used", mode_name, (unsigned)credit, (unsigned)used());
+            } else {
+                CHECK(c == SERIAL_CREDIT_TOKEN, "%s: unexpected byte %02x", mode_name, c);
+                expect_count = true;
+            }
+        } else if (c == SERIAL_XOFF) {
+            CHECK(!stopped, "%s: XOFF twice", mode_name);
+            CHECK(used() >= SERIAL_HIGH_WATER && used() < SERIAL_HIGH_WATER + BYTES_PER_TICK,
+                  "%s: XOFF at %u used", mode_name, (unsigned)used());
+            stopped = true;
+            lag = XOFF_LAG;
+            xoffs++;
+        } else if (c == SERIAL_XON) {
+            CHECK(stopped, "%s: XON while running", mode_name);
+            CHECK(used() <= SERIAL_LOW_WATER, "%s: XON at %u used", mode_name, (unsigned)used());
+            stopped = false;
+            xons++;
+        }
+    }
+}
+
+// The host puts up to BYTES_PER_TICK bytes on the line, as far as flow
+// control allows
+static void host_send() {
+    for (int i = 0; i < BYTES_PER_TICK && sent < STREAM_BYTES; i++) {
+        if (serial_flow_mode == FLOW_XONXOFF && stopped) {
+            if (lag == 0) break;
+            lag--;
+        }
+        if (serial_flow_mode == FLOW_RTSCTS && (gpio_out_state >> SERIAL_RTS_PIN) & 1) break;
+        if (serial_flow_mode == FLOW_CREDIT) {
+            if (credit == 0) break;
+            credit--;
+        }
+        if (!uart_host_receive(uart0, (uint8_t)(sent * 7 + sent / 251))) break;
+        sent++;
+    }
+}
+
+// The main loop: takes up to n bytes, checking the sequence
+static void parse(int n) {
+    const uint8_t *data;
+    uint32_t arrival;
+    size_t len;
+    while (n > 0 && (len = serial_rx_peek(&data, &arrival)) > 0) {
+        if (len > (size_t)n) len = n;
+        for (size_t i = 0; i < len; i++, taken++) {
+            if (data[i] != (uint8_t)(taken * 7 + taken / 251)) {
+                lost = true;
+                serial_rx_release(len);
+                return;
+            }
+        }
+        serial_rx_release(len);
+        n -= len;
+    }
+}
+
+// Returns false if a byte was lost or the stream did not complete
+static bool run(enum flow_modes mode, const char *name) {
+    mode_name = name;
+    sent = taken = 0;
+    stopped = expect_count = lost = false;
+    credit = 0;
+    xoffs = xons = grants = 0;
+    uart_host_hw[0].ris = 0;
+    serial_set_flow_mode(mode);
+    for (long tick = 0; taken < STREAM_BYTES && !lost && tick < 10 * STREAM_BYTES; tick++) {
+        host_send();
+        irq_host_handlers[UART0_IRQ]();
+        // Every 1000 ticks a command keeps the main loop busy for 600;
+        // otherwise it takes more than the line delivers
+        if (tick % 1000 >= 600) parse(BYTES_PER_TICK * 3);
+        serial_rx_service();
+    }
+    return !lost && taken == STREAM_BYTES && !(uart_host_hw[0].ris & UART_UARTRIS_OERIS_BITS);
+}
+
+int main() {
+    serial_rx_init();
+
+    CHECK(run(FLOW_XONXOFF, "xonxoff"), "xonxoff: %u of %u bytes, lost %d", (unsigned)taken, STREAM_BYTES, lost);
+    CHECK(xoffs > 10 && xons == xoffs, "xonxoff: %d XOFF, %d XON", xoffs, xons);
+
+    CHECK(run(FLOW_RTSCTS, "rtscts"), "rtscts: %u of %u bytes, lost %d", (unsigned)taken, STREAM_BYTES, lost);
+
+    CHECK(run(FLOW_CREDIT, "credit"), "credit: %u of %u bytes, lost %d", (unsigned)taken, STREAM_BYTES, lost);
+    CHECK(grants > 10, "credit: %d grants", grants);
+    serial_set_flow_mode(FLOW_NONE);
+
+    // Without flow control the same load overflows: the test can see loss
+    CHECK(!run(FLOW_NONE, "none") && lost, "none: no loss detected without flow control");
+
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("serial flow: ok\n");
+    return 0;
+}
@@ -0,0 +1,287 @@
+// TMS9918A renderer: whole frames from tms9918_render_line compared with a
+// reference that works out each pixel on its own from the datasheet's
+// address formulas, for Graphics I, Graphics II, Text and Multicolor with
+// random VRAM and sprites, plus a few hand-built scenes with known pixels
+// and status flags.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tms9918.h"
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static Tms9918 vdp;
+static uint8_t frame[TMS_HEIGHT][TMS_WIDTH];
+
+// Registers go in through the control port, like a host writes them
+static void set_reg(int reg, uint8_t value) {
+    tms9918_write_control(&vdp, value);
+    tms9918_write_control(&vdp, 0x80 | reg);
+}
+
+static void render_frame() {
+    for (int y = 0; y < TMS_HEIGHT; y++) tms9918_render_line(&vdp, y, frame[y]);
+}
+
+static uint8_t color_or_backdrop(uint8_t color) {
+    return color ? color : vdp.reg[7] & 0x0f;
+}
+
+// Reference: the background pixel at (x, y)
+static uint8_t ref_background(int x, int y) {
+    const uint8_t *r = vdp.reg, *vram = vdp.vram;
+    int name_base = (r[2] & 0x0f) * 0x400;
+    if (r[1] & 0x10) {                                  // Text
+        uint8_t fg = r[7] >> 4, bg = r[7] & 0x0f;
+        if (x < 8 || x >= 8 + 40 * 6) return color_or_backdrop(bg);
+        int name = vram[name_base + (y / 8) * 40 + (x - 8) / 6];
+        int pattern = vram[(r[4] & 0x07) * 0x800 + name * 8 + y % 8];
+        return color_or_backdrop((pattern << ((x - 8) % 6)) & 0x80 ? fg : bg);
+    }
+    int name = vram[name_base + (y / 8) * 32 + x / 8];
+    if (r[1] & 0x08) {                                  // Multicolor
+        int colors = vram[(r[4] & 0x07) * 0x800 + name * 8 + ((y / 8) % 4) * 2 + (y / 4) % 2];
+        return color_or_backdrop(x % 8 < 4 ? colors >> 4 : colors & 0x0f);
+    }
+    int pattern, colors;
+    if (r[0] & 0x02) {                                  // Graphics II
+        // 13-bit table offsets: the third of the screen, the name and the
+        // line; register bits mask the upper address bits
+        int offset = (y / 64) * 0x800 + name * 8 + y % 8;
+        int pg = (r[4] & 0x04 ? 0x2000 : 0) | (offset & ((r[4] & 0x03) * 0x800 + 0x7ff));
+        int ct = (r[3] & 0x80 ? 0x2000 : 0) | (offset & ((r[3] & 0x7f) * 0x40 + 0x3f));
+        pattern = vram[pg];
+        colors = vram[ct];
+    } else {                                            // Graphics I
+        pattern = vram[(r[4] & 0x07) * 0x800 + name * 8 + y % 8];
+        colors = vram[r[3] * 0x40 + name / 8];
+    }
+    return color_or_backdrop((pattern << (x % 8)) & 0x80 ? colors >> 4 : colors & 0x0f);
+}
+
+// Reference: whether sprite s has a pixel at (x, y)
+static bool ref_sprite_pixel(int s, int x, int y) {
+    const uint8_t *r = vdp.reg;
+    const uint8_t *a = &vdp.vram[(r[5] & 0x7f) * 0x80 + s * 4];
+    int size = r[1] & 0x02 ? 16 : 8, mag = r[1] & 0x01 ? 2 : 1;
+    int top = (a[0] >= 0xe0 ? a[0] - 256 : a[0]) + 1;
+    int left = a[1] - (a[3] & 0x80 ? 32 : 0);
+    if (y < top || y >= top + size * mag || x < left || x >= left + size * mag) return false;
+    int row = (y - top) / mag, col = (x - left) / mag;
+    int name = size == 16 ? a[2] & 0xfc : a[2];
+    // 16x16 sprites are four 8x8 quadrants: top left, bottom left, top
+    // right, bottom right
+    int quadrant = (col / 8) * 2 + row / 8;
+    int pattern = vdp.vram[(r[6] & 0x07) * 0x800 + (name + quadrant) * 8 + row % 8];
+    return (pattern << (col % 8)) & 0x80;
+}
+
+static int ref_sprite_count() {
+    const uint8_t *attributes = &vdp.vram[(vdp.reg[5] & 0x7f) * 0x80];
+    int n = 0;
+    while (n < 32 && attributes[n * 4] != 0xd0) n++;
+    return n;
+}
+
+// Reference: whether sprite s covers line y at all
+static bool ref_sprite_on_line(int s, int y) {
+    const uint8_t *a = &vdp.vram[(vdp.reg[5] & 0x7f) * 0x80 + s * 4];
+    int height = (vdp.reg[1] & 0x02 ? 16 : 8) * (vdp.reg[1] & 0x01 ? 2 : 1);
+    int top = (a[0] >= 0xe0 ? a[0] - 256 : a[0]) + 1;
+    return y >= top && y < top + height;
+}
+
+// Reference frame and the status it leaves behind
+static void ref_frame(uint8_t out[TMS_HEIGHT][TMS_WIDTH], uint8_t *status) {
+    bool blank = !(vdp.reg[1] & 0x40), text = vdp.reg[1] & 0x10;
+    int count = ref_sprite_count();
+    *status = 0;
+    for (int y = 0; y < TMS_HEIGHT; y++) {
+        // The first four sprites on the line are shown
+        int shown[4], n = 0;
+        for (int s = 0; s < count && !blank && !text; s++) {
+            if (!ref_sprite_on_line(s, y)) continue;
+            if (n == 4) {
+                if (!(*status & TMS_STATUS_FIFTH)) *status |= TMS_STATUS_FIFTH | s;
+                break;
+            }
+            shown[n++] = s;
+        }
+        for (int x = 0; x < TMS_WIDTH; x++) {
+            if (blank) {
+                out[y][x] = vdp.reg[7] & 0x0f;
+                continue;
+            }
+            uint8_t pixel = ref_background(x, y);
+            int hits = 0;
+            bool drawn = false;
+            for (int i = 0; i < n; i++) {
+                if (!ref_sprite_pixel(shown[i], x, y)) continue;
+                hits++;
+                uint8_t color = vdp.vram[(vdp.reg[5] & 0x7f) * 0x80 + shown[i] * 4 + 3] & 0x0f;
+                if (!drawn && color) {
+                    pixel = color;
+                    drawn = true;
+                }
+            }
+            if (hits > 1) *status |= TMS_STATUS_COINC;
+            out[y][x] = pixel;
+        }
+    }
+}
+
+static void compare(const char *what) {
+    static uint8_t expected[TMS_HEIGHT][TMS_WIDTH];
+    uint8_t status;
+    ref_frame(expected, &status);
+    vdp.status = 0;
+    render_frame();
+    for (int y = 0; y < TMS_HEIGHT; y++) {
+        for (int x = 0; x < TMS_WIDTH; x++) {
+            if (frame[y][x] != expected[y][x]) {
+                CHECK(0, "%s: pixel %d,%d is %d, expected %d", what, x, y, frame[y][x], expected[y][x]);
+                return;
+            }
+        }
+    }
+    CHECK(vdp.status == status, "%s: status %02x, expected %02x", what, vdp.status, status);
+}
+
+// Random VRAM and sprite attributes, with the sprites bunched up so lines
+// often have more than four and sprites overlap
+static void randomize() {
+    for (int i = 0; i < TMS_VRAM_SIZE; i++) vdp.vram[i] = rand();
+    uint8_t *attributes = &vdp.vram[(vdp.reg[5] & 0x7f) * 0x80];
+    for (int s = 0; s < 32; s++) {
+        uint8_t *a = &attributes[s * 4];
+        int kind = rand() % 8;
+        a[0] = kind == 0 ? 0xe0 + rand() % 32 : 40 + rand() % 40;
+        a[1] = 100 + rand() % 60;
+        if (kind == 1) a[1] = rand() % 256;
+        a[3] &= 0x8f;
+        if (a[0] == 0xd0) a[0]++;
+    }
+    if (rand() % 3 == 0) attributes[(rand() % 32) * 4] = 0xd0;
+}
+
+static void test_random_frames() {
+    static const struct { const char *name; uint8_t r0, r1; } modes[] = {
+        { "graphics I", 0x00, 0x40 },
+        { "graphics II", 0x02, 0x40 },
+        { "text", 0x00, 0x50 },
+        { "multicolor", 0x00, 0x48 },
+        { "blank", 0x02, 0x00 },
+    };
+    char what[64];
+    for (int m = 0; m < 5; m++) {
+        for (int round = 0; round < 40; round++) {
+            tms9918_reset(&vdp);
+            set_reg(0, modes[m].r0);
+            set_reg(1, modes[m].r1 | (rand() & 0x03));      // sprite size and magnification
+            for (int r = 2; r < 8; r++) set_reg(r, rand());
+            if (modes[m].r0 & 0x02) {
+                // Mostly the usual table layout, sometimes with the
+                // tables mirrored by the mask bits
+                if (round % 2 == 0) {
+                    set_reg(3, 0xff);
+                    set_reg(4, 0x03);
+                }
+            }
+            randomize();
+            snprintf(what, sizeof(what), "%s, round %d", modes[m].name, round);
+            compare(what);
+        }
+    }
+}
+
+// Hand-built: Graphics I, one character, and the four-sprite limit
+static void test_known_scene() {
+    tms9918_reset(&vdp);
+    set_reg(0, 0x00);
+    set_reg(1, 0x40);           // display on, 8x8 sprites
+    set_reg(2, 0x06);           // names at 0x1800
+    set_reg(3, 0x80);           // colors at 0x2000
+    set_reg(4, 0x00);           // patterns at 0x0000
+    set_reg(5, 0x36);           // sprite attributes at 0x1b00
+    set_reg(6, 0x07);           // sprite patterns at 0x3800
+    set_reg(7, 0x04);           // backdrop dark blue
+
+    // Character 1 is a vertical bar in white on transparent at column 2,
+    // row 1
+    for (int i = 0; i < 8; i++) vdp.vram[0x0008 + i] = 0x18;
+    vdp.vram[0x2000] = 0xf0;
+    vdp.vram[0x1800 + 32 + 2] = 1;
+    // Sprite pattern 0 is solid; five sprites on lines 100-107
+    memset(&vdp.vram[0x3800], 0xff, 8);
+    for (int s = 0; s < 5; s++) {
+        uint8_t *a = &vdp.vram[0x1b00 + s * 4];
+        a[0] = 99;
+        a[1] = s * 4;           // overlapping by four pixels
+        a[2] = 0;
+        a[3] = 2 + s;
+    }
+    vdp.vram[0x1b00 + 5 * 4] = 0xd0;
+    render_frame();
+
+    CHECK(frame[8][16 + 2] == 0x04 && frame[8][16 + 3] == 0x0f && frame[8][16 + 4] == 0x0f && frame[8][16 + 5] == 0x04,
+          "bar pixels %d %d %d %d", frame[8][18], frame[8][19], frame[8][20], frame[8][21]);
+    CHECK(frame[15][19] == 0x0f && frame[16][19] == 0x04, "bar rows");
+    CHECK(frame[99][0] == 0x04 && frame[100][0] == 2 && frame[107][0] == 2 && frame[108][0] == 0x04, "sprite rows");
+    CHECK(frame[100][4] == 2, "sprite 0 under sprite 1");
+    CHECK(frame[100][8] == 3 && frame[100][12] == 4 && frame[100][19] == 5, "sprites 1-3");
+    CHECK(frame[100][20] == 0x04, "the fifth sprite was drawn: %d", frame[100][20]);
+    CHECK(vdp.status == (TMS_STATUS_FIFTH | TMS_STATUS_COINC | 4), "status %02x", vdp.status);
+    tms9918_read_status(&vdp);
+    CHECK(!(vdp.status & (TMS_STATUS_FIFTH | TMS_STATUS_COINC)), "flags not cleared by reading: %02x", vdp.status);
+}
+
+// Hand-built: Text mode borders and a magnified 16x16 sprite in Graphics II
+static void test_known_text_and_sprite() {
+    tms9918_reset(&vdp);
+    set_reg(1, 0x50);           // Text
+    set_reg(2, 0x00);
+    set_reg(4, 0x01);           // patterns at 0x0800
+    set_reg(7, 0xe1);           // gray on black
+    vdp.vram[0x0800 + 0x41 * 8] = 0xfc;             // top line of 'A' all six pixels set
+    vdp.vram[0] = 0x41;
+    render_frame();
+    CHECK(frame[0][7] == 1 && frame[0][8] == 0x0e && frame[0][13] == 0x0e && frame[0][14] == 1, "text cell edges");
+    CHECK(frame[0][248] == 1, "right border");
+
+    tms9918_reset(&vdp);
+    set_reg(0, 0x02);
+    set_reg(1, 0x43);           // Graphics II, 16x16 sprites, magnified
+    set_reg(3, 0xff);
+    set_reg(4, 0x03);
+    set_reg(5, 0x36);
+    set_reg(6, 0x07);
+    set_reg(7, 0x01);
+    // Sprite name 4: top right quadrant (patterns 6) solid, the rest clear
+    memset(&vdp.vram[0x3800 + 6 * 8], 0xff, 8);
+    uint8_t *a = &vdp.vram[0x1b00];
+    a[0] = 0xff;                // Y -1: top on line 0
+    a[1] = 40;
+    a[2] = 5;                   // low bits ignored for 16x16
+    a[3] = 0x80 | 9;            // early clock: 32 pixels left
+    a[4] = 0xd0;
+    render_frame();
+    CHECK(frame[0][8 + 15] == 1 && frame[0][8 + 16] == 9 && frame[15][8 + 31] == 9 && frame[16][8 + 16] == 1,
+          "magnified quadrant");
+    CHECK(vdp.status == 0, "status %02x", vdp.status);
+}
+
+int main() {
+    srand(1);
+    test_known_scene();
+    test_known_text_and_sprite();
+    test_random_frames();
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("tms9918: ok\n");
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include <stddef.h>
+#include <string.h>
+#include "tms9918.h"
+
+// Register 0/1 mode bits
+#define R0_M3   0x02    // Graphics II
+#define R1_BL   0x40    // display enabled
+#define R1_M1   0x10    // Text
+#define R1_M2   0x08    // Multicolor
+#define R1_SIZE 0x02    // 16x16 sprites
+#define R1_MAG  0x01    // sprites magnified 2x
+
+#define SPRITE_END      0xd0    // Y value that ends the sprite attribute list
+#define SPRITES_PER_LINE 4
+
+void tms9918_reset(Tms9918 *vdp) {
+    memset(vdp, 0, sizeof(*vdp));
+    vdp->dirty = true;
+}
+
+void tms9918_write_data(Tms9918 *vdp, uint8_t value) {
+    vdp->latched = false;
+    vdp->vram[vdp->address] = value;
+    vdp->read_ahead = value;
+    vdp->address = (vdp->address + 1) & (TMS_VRAM_SIZE - 1);
+    vdp->dirty = true;
+}
+
+// Control port writes come in pairs: data/address low byte first, then
+// either 10rrrrrr (write the first byte to register r) or 0Waaaaaa (set
+// the address, for writing when W is set, otherwise pre-reading it)
+void tms9918_write_control(Tms9918 *vdp, uint8_t value) {
+    if (!vdp->latched) {
+        vdp->latch = value;
+        vdp->latched = true;
+        return;
+    }
+    vdp->latched = false;
+    if (value & 0x80) {
+        vdp->reg[value & 0x07] = vdp->latch;
+        vdp->dirty = true;
+    } else {
+        vdp->address = ((value & 0x3f) << 8) | vdp->latch;
+        if (!(value & 0x40)) {
+            vdp->read_ahead = vdp->vram[vdp->address];
+            vdp->address = (vdp->address + 1) & (TMS_VRAM_SIZE - 1);
+        }
+    }
+}
+
+uint8_t tms9918_read_data(Tms9918 *vdp) {
+    uint8_t value = vdp->read_ahead;
+    vdp->latched = false;
+    vdp->read_ahead = vdp->vram[vdp->address];
+    vdp->address = (vdp->address + 1) & (TMS_VRAM_SIZE - 1);
+    return value;
+}
+
+// Reading the status clears the interrupt, fifth sprite and coincidence
+// flags
+uint8_t tms9918_read_status(Tms9918 *vdp) {
+    uint8_t value = vdp->status;
+    vdp->latched = false;
+    vdp->status &= ~(TMS_STATUS_INT | TMS_STATUS_FIFTH | TMS_STATUS_COINC);
+    return value;
+}
+
+// Expand one pattern byte into 8 pixels of two colors
+static inline void pattern8(uint8_t *out, uint8_t pattern, uint8_t fg, uint8_t bg) {
+    for (int bit = 7; bit >= 0; bit--) {
+        *out++ = (pattern >> bit) & 1 ? fg : bg;
+    }
+}
+
+static void render_text(const Tms9918 *vdp, int line, uint8_t *out, uint8_t backdrop) {
+    const uint8_t *names = &vdp->vram[(vdp->reg[2] & 0x0f) << 10];
+    const uint8_t *patterns = &vdp->vram[(vdp->reg[4] & 0x07) << 11];
+    uint8_t fg = vdp->reg[7] >> 4, bg = backdrop;
+    if (fg == 0) fg = backdrop;
+
+    memset(out, backdrop, 8);
+    memset(out + 248, backdrop, 8);
+    out += 8;
+    for (int col = 0; col < 40; col++) {
+        uint8_t pattern = patterns[names[(line >> 3) * 40 + col] * 8 + (line & 7)];
+        for (int bit = 7; bit >= 2; bit--) {
+            *out++ = (pattern >> bit) & 1 ? fg : bg;
+        }
+    }
+}
+
+static void render_multicolor(const Tms9918 *vdp, int line, uint8_t *out, uint8_t backdrop) {
+    const uint8_t *names = &vdp->vram[(vdp->reg[2] & 0x0f) << 10];
+    const uint8_t *patterns = &vdp->vram[(vdp->reg[4] & 0x07) << 11];
+    int offset = ((line >> 3) & 3) * 2 + ((line >> 2) & 1);
+
+    for (int col = 0; col < 32; col++) {
+        uint8_t colors = patterns[names[(line >> 3) * 32 + col] * 8 + offset];
+        uint8_t left = colors >> 4, right = colors & 0x0f;
+        if (left == 0) left = backdrop;
+        if (right == 0) right = backdrop;
+        memset(out, left, 4);
+        memset(out + 4, right, 4);
+        out += 8;
+    }
+}
+
+// Graphics I (one color pair per 8 patterns) and Graphics II (a pattern
+// and color byte per pattern line, with the screen split in thirds)
+static void render_graphics(const Tms9918 *vdp, int line, uint8_t *out, uint8_t backdrop) {
+    const uint8_t *names = &vdp->vram[((vdp->reg[2] & 0x0f) << 10) + (line >> 3) * 32];
+    bool mode2 = vdp->reg[0] & R0_M3;
+
+    for (int col = 0; col < 32; col++) {
+        uint8_t pattern, colors;
+        if (mode2) {
+            uint16_t index = (((line >> 6) << 8) | names[col]) << 3 | (line & 7);
+            pattern = vdp->vram[((vdp->reg[4] & 0x04) << 11) | (index & (((vdp->reg[4] & 0x03) << 11) | 0x7ff))];
+            colors = vdp->vram[((vdp->reg[3] & 0x80) << 6) | (index & (((vdp->reg[3] & 0x7f) << 6) | 0x3f))];
+        } else {
+            pattern = vdp->vram[((vdp->reg[4] & 0x07) << 11) + names[col] * 8 + (line & 7)];
+            colors = vdp->vram[(vdp->reg[3] << 6) + (names[col] >> 3)];
+        }
+        uint8_t fg = colors >> 4, bg = colors & 0x0f;
+        pattern8(out, pattern, fg ? fg : backdrop, bg ? bg : backdrop);
+        out += 8;
+    }
+}
+
+// Overlay the sprites on one line (or, without out, only update the
+// status flags). Lower numbered sprites have priority; only the first four
+// on a line are shown, and the fifth is reported.
+static void render_sprites(Tms9918 *vdp, int line, uint8_t *out) {
+    const uint8_t *attributes = &vdp->vram[(vdp->reg[5] & 0x7f) << 7];
+    const uint8_t *patterns = &vdp->vram[(vdp->reg[6] & 0x07) << 11];
+    int size = (vdp->reg[1] & R1_SIZE) ? 16 : 8;
+    int mag = (vdp->reg[1] & R1_MAG) ? 1 : 0;
+    int height = size << mag;
+    uint8_t occupied[TMS_WIDTH];    // bit 0: a sprite pixel, bit 1: a visible one
+    int shown = 0;
+
+    memset(occupied, 0, sizeof(occupied));
+    for (int s = 0; s < 32; s++) {
+        const uint8_t *a = &attributes[s * 4];
+        if (a[0] == SPRITE_END) break;
+
+        int top = a[0] + 1;
+        if (top > 0xe0) top -= 256;     // Y near 255 starts above the screen
+        int row = line - top;
+        if (row < 0 || row >= height) continue;
+
+        if (shown == SPRITES_PER_LINE) {
+            if (!(vdp->status & TMS_STATUS_FIFTH)) {
+                vdp->status = (vdp->status & ~TMS_STATUS_FIFTH_NUM) | TMS_STATUS_FIFTH | s;
+            }
+            break;
+        }
+        shown++;
+
+        int x = (a[3] & 0x80) ? a[1] - 32 : a[1];   // early clock bit
+        uint8_t color = a[3] & 0x0f;
+        uint8_t name = (size == 16) ? (a[2] & 0xfc) : a[2];
+        row >>= mag;
+        uint16_t bits = patterns[name * 8 + row] << 8;
+        if (size == 16) bits |= patterns[name * 8 + 16 + row];
+
+        for (int px = 0; px < (size << mag); px++) {
+            if (!((bits << (px >> mag)) & 0x8000)) continue;
+            int sx = x + px;
+            if (sx < 0 || sx >= TMS_WIDTH) continue;
+            if (occupied[sx] & 1) vdp->status |= TMS_STATUS_COINC;
+            occupied[sx] |= 1;
+            if (out != NULL && color != 0 && !(occupied[sx] & 2)) {
+                out[sx] = color;
+                occupied[sx] |= 2;
+            }
+        }
+    }
+}
+
+void tms9918_render_line(Tms9918 *vdp, int line, uint8_t *out) {
+    uint8_t backdrop = tms9918_backdrop(vdp);
+
+    if (!(vdp->reg[1] & R1_BL)) {
+        memset(out, backdrop, TMS_WIDTH);
+        return;
+    }
+    if (vdp->reg[1] & R1_M1) {
+        render_text(vdp, line, out, backdrop);
+        return;                         // no sprites in Text mode
+    }
+    if (vdp->reg[1] & R1_M2) {
+        render_multicolor(vdp, line, out, backdrop);
+    } else {
+        render_graphics(vdp, line, out, backdrop);
+    }
+    render_sprites(vdp, line, out);
+}
+
+// Scan the sprites of a whole frame for the fifth sprite and coincidence
+// flags without rendering anything
+void tms9918_scan_sprites(Tms9918 *vdp) {
+    if (!(vdp->reg[1] & R1_BL) || (vdp->reg[1] & R1_M1)) return;
+    for (int line = 0; line < TMS_HEIGHT; line++) {
+        render_sprites(vdp, line, NULL);
+    }
+}
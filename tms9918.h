@@ -0,0 +1,59 @@
+/**
+ * TMS9918A video display processor emulation core
+ *
+ * Register and VRAM port semantics of the TMS9918A (16 kB VRAM, 8 write-only
+ * registers, status register, two-byte control port writes, read-ahead
+ * data port) and a scanline renderer for Graphics I, Graphics II, Text and
+ * Multicolor modes with 32 sprites, the four-sprites-per-line limit, the
+ * fifth sprite flag and the coincidence flag.
+ *
+ * Plain C with no hardware dependencies, so the renderer can be built and
+ * checked on a host. vdp.c connects it to the input parser and scales
+ * the output into the framebuffer.
+ */
+
+#ifndef TMS9918_H
+#define TMS9918_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TMS_VRAM_SIZE 0x4000
+#define TMS_WIDTH     256
+#define TMS_HEIGHT    192
+
+// Status register bits
+#define TMS_STATUS_INT       0x80   // frame ended
+#define TMS_STATUS_FIFTH     0x40   // fifth sprite on a line
+#define TMS_STATUS_COINC     0x20   // two sprites overlap
+#define TMS_STATUS_FIFTH_NUM 0x1f   // number of the fifth sprite
+
+typedef struct {
+    uint8_t vram[TMS_VRAM_SIZE];
+    uint8_t reg[8];
+    uint8_t status;
+    uint16_t address;       // VRAM address for the data port
+    uint8_t latch;          // first byte of a control port pair
+    bool latched;
+    uint8_t read_ahead;     // data port read buffer
+    bool dirty;             // VRAM or registers changed since the last frame
+} Tms9918;
+
+void tms9918_reset(Tms9918 *vdp) ;
+void tms9918_write_data(Tms9918 *vdp, uint8_t value) ;
+void tms9918_write_control(Tms9918 *vdp, uint8_t value) ;
+uint8_t tms9918_read_data(Tms9918 *vdp) ;
+uint8_t tms9918_read_status(Tms9918 *vdp) ;
+
+// Render one of the 192 active lines as TMS color indices (0-15, with
+// transparent pixels already replaced by the backdrop). Updates the sprite
+// status flags as the real chip does while it scans the line.
+void tms9918_render_line(Tms9918 *vdp, int line, uint8_t *out) ;
+void tms9918_scan_sprites(Tms9918 *vdp) ;
+
+// Backdrop color (register 7 low nibble), used for the border
+static inline uint8_t tms9918_backdrop(const Tms9918 *vdp) {
+    return vdp->reg[7] & 0x0f;
+}
+
+#endif
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""
+Loopback test for credit flow control: switch the board to /FLOW CREDIT,
+send console text as fast as the credits allow, then check with /FLOW that
+every byte arrived and none was dropped or overrun.
+
+Usage: flowtest.py /dev/ttyUSB0 [bytes] [baud]
+
+Needs pyserial.
+"""
+
+import re
+import sys
+import time
+
+import serial
+
+CREDIT_TOKEN = 0x06
+CREDIT_UNIT = 64    # keep in step with SERIAL_CREDIT_UNIT in serial_rx.h
+
+
+class CreditLink:
+    def __init__(self, port):
+        self.port = port
+        self.credit = 0
+        self.pending_token = False
+        self.text = bytearray()
+
+    def poll(self, timeout=0.0):
+        """Read whatever is waiting, splitting credit grants from replies."""
+        self.port.timeout = timeout
+        data = self.port.read(max(1, self.port.in_waiting))
+        for b in data:
+            if self.pending_token:
+                self.credit += b * CREDIT_UNIT
+                self.pending_token = False
+            elif b == CREDIT_TOKEN:
+                self.pending_token = True
+            else:
+                self.text.append(b)
+
+    def send(self, data):
+        pos = 0
+        while pos < len(data):
+            if self.credit == 0:
+                self.poll(0.01)
+                continue
+            chunk = data[pos:pos + self.credit]
+            self.port.write(chunk)
+            self.credit -= len(chunk)
+            pos += len(chunk)
+            self.poll()
+
+    def query(self, timeout=2.0):
+        """Send /FLOW and return its report as a dict."""
+        self.text.clear()
+        self.send(b"/FLOW\r")
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            self.poll(0.05)
+            m = re.search(rb"Flow: (\S+) (.*)\n", self.text)
+            if m:
+                fields = dict(f.split(b"=") for f in m.group(2).split())
+                return {k.decode(): v.decode() for k, v in fields.items()}
+        raise RuntimeError("no reply to /FLOW")
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    total = int(sys.argv[2]) if len(sys.argv) > 2 else 100000
+    baud = int(sys.argv[3]) if len(sys.argv) > 3 else 115200
+
+    port = serial.Serial(sys.argv[1], baud)
+    link = CreditLink(port)
+    port.write(b"/FLOW CREDIT\r")
+    time.sleep(0.2)
+
+    before = link.query()
+    line = b"The quick brown fox jumps over the lazy dog 0123456789\r\n"
+    payload = (line * (total // len(line) + 1))[:total]
+    start = time.time()
+    link.send(payload)
+    after = link.query(timeout=30.0)
+    elapsed = time.time() - start
+
+    received = int(after["received"]) - int(before["received"])
+    expected = len(payload) + len(b"/FLOW\r")
+    print("sent %d bytes in %.2fs (%.0f bytes/s)" % (len(payload), elapsed, len(payload) / elapsed))
+    print("received %d, expected %d, overruns %s, dropped %s"
+          % (received, expected, after["overruns"], after["dropped"]))
+
+    port.write(b"/FLOW NONE\r")
+    ok = (received == expected and after["overruns"] == before["overruns"]
+          and after["dropped"] == before["dropped"])
+    print("PASS" if ok else "FAIL")
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""
+Console throughput benchmark: replay a recorded log dump (any text file, or a
+generated one) as console text, once with /CONSOLE IMMEDIATE and once with
+/CONSOLE BATCHED, and compare how fast the board takes it and how many cells
+it had to draw. Credit flow control keeps the link lossless, so the time is
+set by how fast the firmware consumes the text.
+
+Usage: logbench.py /dev/ttyUSB0 [logfile] [baud]
+
+Needs pyserial.
+"""
+
+import re
+import sys
+import time
+
+import serial
+
+from flowtest import CreditLink
+
+
+def generated_log(size=200000):
+    lines = []
+    total = 0
+    i = 0
+    while total < size:
+        line = "2024-05-01 12:%02d:%02d.%03d INFO worker[%d] processed request id=%d status=ok\n" % (
+            i // 60 % 60, i % 60, i % 1000, i % 8, i)
+        lines.append(line)
+        total += len(line)
+        i += 1
+    return "".join(lines).encode()
+
+
+def console_stats(link, timeout=30.0):
+    """Send /CONSOLE and return its counters as a dict."""
+    link.text.clear()
+    link.send(b"/CONSOLE\r")
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        link.poll(0.05)
+        m = re.search(rb"Console: (\S+) (.*)\n", link.text)
+        if m:
+            fields = dict(f.split(b"=") for f in m.group(2).split())
+            return {k.decode(): int(v) for k, v in fields.items()}
+    raise RuntimeError("no reply to /CONSOLE")
+
+
+def run(link, mode, payload):
+    link.send(b"/CONSOLE " + mode + b"\r")
+    before = console_stats(link)
+    start = time.time()
+    link.send(payload)
+    after = console_stats(link)     # answered once all the text is consumed
+    elapsed = time.time() - start
+    chars = after["chars"] - before["chars"]
+    drawn = after["drawn"] - before["drawn"]
+    print("%-9s %8.0f bytes/s  %7d chars  %7d cells drawn  %5d flushes"
+          % (mode.decode().lower(), len(payload) / elapsed, chars, drawn, after["flushes"] - before["flushes"]))
+    return elapsed
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    payload = open(sys.argv[2], "rb").read() if len(sys.argv) > 2 else generated_log()
+    baud = int(sys.argv[3]) if len(sys.argv) > 3 else 115200
+    payload = payload.replace(b"/", b"|").translate(None, b"\002\003\020\033")   # plain console text only
+
+    port = serial.Serial(sys.argv[1], baud)
+    link = CreditLink(port)
+    port.write(b"/FLOW CREDIT\r")
+    time.sleep(0.2)
+
+    immediate = run(link, b"IMMEDIATE", payload)
+    batched = run(link, b"BATCHED", payload)
+    print("speedup %.2fx" % (immediate / batched))
+
+    port.write(b"/FLOW NONE\r")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""
+Convert a /TRACE dump captured from the serial port into Chrome
+trace-event JSON (open it in chrome://tracing or https://ui.perfetto.dev).
+
+Usage: trace2chrome.py capture.txt > trace.json
+
+Only lines of the form "T <core> <timestamp_us> <event> <arg>" are read,
+so the capture may contain any other console output around the dump.
+"""
+
+import json
+import sys
+
+# Keep in step with enum trace_events in trace.h
+EVENT_NAMES = {
+    1: "rx",
+    2: "command",      # begin
+    3: "command",      # end
+    4: "scroll",
+    5: "vsync",
+    6: "core_handoff",
+}
+CMD_BEGIN = 2
+CMD_END = 3
+
+
+def convert(lines):
+    events = []
+    last = {}       # per-core raw timestamp, for unwrapping the 32-bit timer
+    offset = {}
+    for line in lines:
+        fields = line.split()
+        if len(fields) != 5 or fields[0] != "T":
+            continue
+        core, ts, event, arg = (int(f) for f in fields[1:])
+        if core in last and ts < last[core]:
+            offset[core] = offset.get(core, 0) + (1 << 32)
+        last[core] = ts
+        ts += offset.get(core, 0)
+
+        name = EVENT_NAMES.get(event, "event_%d" % event)
+        record = {"name": name, "ts": ts, "pid": 0, "tid": core,
+                  "args": {"arg": arg}}
+        if event == CMD_BEGIN:
+            record["ph"] = "B"
+            record["args"]["command"] = "/" + chr(arg) if 32 <= arg < 127 else arg
+        elif event == CMD_END:
+            record["ph"] = "E"
+        else:
+            record["ph"] = "i"
+            record["s"] = "g" if name == "vsync" else "t"
+        events.append(record)
+
+    events.sort(key=lambda e: e["ts"])
+    meta = [{"name": "thread_name", "ph": "M", "pid": 0, "tid": core,
+             "args": {"name": "core%d" % core}} for core in sorted(last)]
+    return {"traceEvents": meta + events, "displayTimeUnit": "ms"}
+
+
+def main():
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    with source:
+        json.dump(convert(source), sys.stdout, indent=1)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "trace.h"
+
+// One ring per core. A core only ever writes its own ring and head.
+static TraceRecord trace_ring[2][TRACE_RING_SIZE];
+static volatile uint32_t trace_head[2];
+
+// Record one event. Safe from either core and from interrupt handlers:
+// masking interrupts on this core keeps a nested handler from claiming
+// the same slot, and the other core never touches this ring.
+void __not_in_flash_func(trace_record)(uint16_t event, uint16_t arg) {
+    uint core = get_core_num();
+    uint32_t status = save_and_disable_interrupts();
+    TraceRecord *rec = &trace_ring[core][trace_head[core] & (TRACE_RING_SIZE - 1)];
+    rec->timestamp = timer_hw->timerawl;
+    rec->event = event;
+    rec->arg = arg;
+    trace_head[core]++;
+    restore_interrupts(status);
+}
+
+void trace_clear(void) {
+    for (int core = 0; core < 2; core++) {
+        trace_head[core] = 0;
+    }
+}
+
+// Print both rings, oldest record first, one record per line:
+//   T <core> <timestamp_us> <event> <arg>
+void trace_dump(void) {
+    printf("\nTRACE BEGIN\n");
+    for (int core = 0; core < 2; core++) {
+        uint32_t head = trace_head[core];
+        uint32_t start = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+        for (uint32_t i = start; i < head; i++) {
+            TraceRecord rec = trace_ring[core][i & (TRACE_RING_SIZE - 1)];
+            printf("T %d %lu %u %u\n", core, (unsigned long)rec.timestamp, rec.event, rec.arg);
+        }
+    }
+    printf("TRACE END\n");
+}
@@ -0,0 +1,56 @@
+/**
+ * Lightweight binary trace ring for hot-path events
+ *
+ * Each record is a (timestamp, event id, arg) triple. Every core writes
+ * into its own ring, so recording never takes a lock: the only shared
+ * step is reserving a slot, which is done with interrupts masked on the
+ * recording core for a few cycles. Rings wrap, keeping the most recent
+ * TRACE_RING_SIZE records per core.
+ *
+ * Dump the rings with /TRACE and convert the capture to Chrome
+ * trace-event JSON with tools/trace2chrome.py.
+ *
+ * Build with -DTRACE_ENABLED=0 to compile every TRACE() call out.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+// Records per core (must be a power of two). 8 bytes each.
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 256
+#endif
+
+// Event ids - keep in step with EVENT_NAMES in tools/trace2chrome.py
+enum trace_events {
+    TRACE_RX = 1,           // arg: length of the received run or packet
+    TRACE_CMD_BEGIN,        // arg: first letter of the command
+    TRACE_CMD_END,          // arg: first letter of the command
+    TRACE_SCROLL,           // arg: cursor row that caused the scroll
+    TRACE_VSYNC,            // arg: low 16 bits of the frame counter
+    TRACE_CORE_HANDOFF,     // arg: work item handed to the other core
+} ;
+
+typedef struct {
+    uint32_t timestamp;     // microseconds from the free-running timer
+    uint16_t event;
+    uint16_t arg;
+} TraceRecord;
+
+void trace_record(uint16_t event, uint16_t arg) ;
+void trace_clear(void) ;
+void trace_dump(void) ;
+
+#if TRACE_ENABLED
+#define TRACE(event, arg) trace_record((event), (uint16_t)(arg))
+#else
+#define TRACE(event, arg) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+#include "transport.h"
+#include "serial_rx.h"
+#if LIB_PICO_STDIO_USB
+#include "pico/stdio_usb.h"
+#endif
+
+// UART: runs come straight out of the interrupt-fed receive ring
+
+static void uart_transport_write(const char *data, size_t len) {
+    uart_write_blocking(uart0, (const uint8_t *)data, len);
+}
+
+const Transport uart_transport = {
+    "uart", serial_rx_peek, serial_rx_release, uart_transport_write
+};
+
+// USB CDC: one bulk packet at a time, read as a block through the stdio
+// driver (which serialises access to TinyUSB with its background task)
+
+static uint8_t usb_packet[USB_PACKET_SIZE];
+static size_t usb_start = 0, usb_end = 0;
+static uint32_t usb_arrival_us;
+
+static size_t usb_receive(const uint8_t **data, uint32_t *arrival_us) {
+#if LIB_PICO_STDIO_USB
+    if (usb_start == usb_end) {
+        int n = stdio_usb.in_chars((char *)usb_packet, USB_PACKET_SIZE);
+        if (n <= 0) return 0;
+        usb_start = 0;
+        usb_end = n;
+        usb_arrival_us = time_us_32();
+    }
+#endif
+    *data = &usb_packet[usb_start];
+    *arrival_us = usb_arrival_us;
+    return usb_end - usb_start;
+}
+
+static void usb_release(size_t n) {
+    usb_start += n;
+}
+
+static void usb_write(const char *data, size_t len) {
+#if LIB_PICO_STDIO_USB
+    if (stdio_usb_connected()) stdio_usb.out_chars(data, len);
+#endif
+}
+
+const Transport usb_transport = {
+    "usb", usb_receive, usb_release, usb_write
+};
+
+// Injection: packets handed over by transport_inject(), for host builds
+// and test tools that drive the parser without hardware. Output goes to
+// stdout.
+
+static const uint8_t *inject_data = NULL;
+static size_t inject_len = 0;
+
+int transport_inject(const uint8_t *data, size_t len) {
+    if (inject_len != 0) return 0;
+    inject_data = data;
+    inject_len = len;
+    return 1;
+}
+
+static size_t inject_receive(const uint8_t **data, uint32_t *arrival_us) {
+    *data = inject_data;
+    *arrival_us = time_us_32();
+    return inject_len;
+}
+
+static void inject_release(size_t n) {
+    inject_data += n;
+    inject_len -= n;
+}
+
+static void inject_write(const char *data, size_t len) {
+    fwrite(data, 1, len, stdout);
+}
+
+const Transport inject_transport = {
+    "inject", inject_receive, inject_release, inject_write
+};
@@ -0,0 +1,39 @@
+/**
+ * Command transports
+ *
+ * Every input path (the UART receive ring, USB CDC, the 8-bit parallel
+ * bus, the SPI slave, and an injection transport for host-side tools and emulators) hands the parser runs of
+ * received bytes that it parses in place: a UART run is a contiguous
+ * stretch of the receive ring, a USB run is one 64-byte bulk packet.
+ * Replies and echo go back through the same transport's write().
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+    const char *name;
+    // Next run of received bytes, or 0 if nothing is waiting. The run stays
+    // valid until release() is called.
+    size_t (*receive)(const uint8_t **data, uint32_t *arrival_us);
+    // Done with the first n bytes of the run returned by receive()
+    void (*release)(size_t n);
+    void (*write)(const char *data, size_t len);
+} Transport;
+
+#define USB_PACKET_SIZE 64
+
+extern const Transport uart_transport;
+extern const Transport usb_transport;
+extern const Transport parallel_transport;
+extern const Transport spi_transport;
+extern const Transport inject_transport;
+
+// Queue a packet on the injection transport. The data must stay valid
+// until the parser has consumed it; returns 0 if a packet is still pending.
+int transport_inject(const uint8_t *data, size_t len) ;
+
+#endif
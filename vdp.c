@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "vga16_graphics.h"
+#include "tms9918.h"
+#include "emulation.h"
+#include "vdp.h"
+
+extern unsigned char vga_data_array[] ;
+extern void redraw_screen() ;
+
+bool vdp_active = false;
+
+EmulationRam emulation_ram;
+
+static Tms9918 *const vdp = &emulation_ram.tms;
+static uint32_t last_frame;
+static int last_backdrop = -1;
+static uint32_t stat_frames = 0, stat_render_us = 0;
+
+// Closest of our colors to each TMS color, nudged so colors that differ
+// on the TMS stay different here (0 is transparent and never rendered)
+static const uint8_t tms_palette[16] = {
+    0x0,    // transparent
+    0x0,    // black        -> BLACK
+    0x2,    // medium green -> MED_GREEN
+    0x3,    // light green  -> GREEN
+    0x4,    // dark blue    -> DARK_BLUE
+    0x5,    // light blue   -> BLUE
+    0x8,    // dark red     -> RED
+    0x7,    // cyan         -> CYAN
+    0x9,    // medium red   -> DARK_ORANGE
+    0xD,    // light red    -> PINK
+    0xA,    // dark yellow  -> ORANGE
+    0xB,    // light yellow -> YELLOW
+    0x1,    // dark green   -> DARK_GREEN
+    0xC,    // magenta      -> MAGENTA
+    0xE,    // gray         -> LIGHT_PINK
+    0xF,    // white        -> WHITE
+};
+
+// A framebuffer byte showing two pixels of the same TMS color
+static inline uint8_t pixel_pair(uint8_t tms_color) {
+    uint8_t c = tms_palette[tms_color];
+    return (c << 4) | c;
+}
+
+void vdp_enable(bool enable) {
+    if (enable == vdp_active) return;
+    vdp_active = enable;
+    if (enable) {
+        tms9918_reset(vdp);
+        last_frame = vga_frame_count;
+        last_backdrop = -1;
+    } else {
+        redraw_screen();
+    }
+}
+
+// Border in the backdrop color, redrawn only when the backdrop changes
+static void draw_border(uint8_t backdrop) {
+    uint8_t pair = pixel_pair(backdrop);
+    memset(vga_data_array, pair, VDP_TOP * 320);
+    memset(&vga_data_array[(VDP_TOP + 2 * TMS_HEIGHT) * 320], pair, (480 - VDP_TOP - 2 * TMS_HEIGHT) * 320);
+    for (int y = VDP_TOP; y < VDP_TOP + 2 * TMS_HEIGHT; y++) {
+        memset(&vga_data_array[y * 320], pair, VDP_LEFT / 2);
+        memset(&vga_data_array[y * 320 + (VDP_LEFT + 2 * TMS_WIDTH) / 2], pair, (640 - VDP_LEFT - 2 * TMS_WIDTH) / 2);
+    }
+    vga_damage_rect(0, 0, 640, 480);
+}
+
+// Each TMS pixel becomes one framebuffer byte (two pixels wide) on two rows
+static void render_frame() {
+    static uint8_t line_buf[TMS_WIDTH];
+    uint32_t start = time_us_32();
+
+    uint8_t backdrop = tms9918_backdrop(vdp);
+    if (backdrop != last_backdrop) {
+        draw_border(backdrop);
+        last_backdrop = backdrop;
+    }
+    for (int line = 0; line < TMS_HEIGHT; line++) {
+        tms9918_render_line(vdp, line, line_buf);
+        uint8_t *row = &vga_data_array[(VDP_TOP + 2 * line) * 320 + VDP_LEFT / 2];
+        for (int x = 0; x < TMS_WIDTH; x++) {
+            row[x] = pixel_pair(line_buf[x]);
+        }
+        memcpy(row + 320, row, TMS_WIDTH);
+    }
+    vga_damage_rect(VDP_LEFT, VDP_TOP, 2 * TMS_WIDTH, 2 * TMS_HEIGHT);
+
+    stat_frames++;
+    stat_render_us = time_us_32() - start;
+}
+
+// Once per displayed frame: raise the frame flag, and redraw if anything
+// changed. Otherwise only the sprite flags are rescanned, since a host
+// reading the status clears them and expects them back next frame.
+void vdp_service() {
+    if (!vdp_active) return;
+    uint32_t frame = vga_frame_count;
+    if (frame == last_frame) return;
+    last_frame = frame;
+
+    vdp->status |= TMS_STATUS_INT;
+    if (vdp->dirty) {
+        vdp->dirty = false;
+        render_frame();
+    } else {
+        tms9918_scan_sprites(vdp);
+    }
+}
+
+size_t vdp_input(VdpParser *p, const uint8_t *data, size_t len, const Transport *t) {
+    size_t i = 0;
+    while (i < len && vdp_active) {
+        if (p->op == 0) {
+            p->op = data[i++];
+            p->have_count = false;
+            if (p->op == 'S') {
+                uint8_t status = tms9918_read_status(vdp);
+                t->write((const char *)&status, 1);
+                p->op = 0;
+            } else if (p->op == 'X') {
+                p->op = 0;
+                vdp_enable(false);
+            } else if (p->op != 'D' && p->op != 'C' && p->op != 'R') {
+                p->op = 0;      // not a record: skip the byte
+            }
+            continue;
+        }
+        if (p->op == 'C') {
+            tms9918_write_control(vdp, data[i++]);
+            p->op = 0;
+            continue;
+        }
+        if (!p->have_count) {
+            p->remaining = data[i++];
+            if (p->remaining == 0) p->remaining = 256;
+            p->have_count = true;
+            if (p->op == 'R') {
+                while (p->remaining > 0) {
+                    uint8_t chunk[64];
+                    int n = 0;
+                    while (n < (int)sizeof(chunk) && p->remaining > 0) {
+                        chunk[n++] = tms9918_read_data(vdp);
+                        p->remaining--;
+                    }
+                    t->write((const char *)chunk, n);
+                }
+                p->op = 0;
+            }
+            continue;
+        }
+        // 'D' payload
+        while (i < len && p->remaining > 0) {
+            tms9918_write_data(vdp, data[i++]);
+            p->remaining--;
+        }
+        if (p->remaining == 0) p->op = 0;
+    }
+    return i;
+}
+
+void vdp_report() {
+    printf("\nVDP: %s frames=%lu render=%luus status=%02x regs=%02x %02x %02x %02x %02x %02x %02x %02x\n",
+           vdp_active ? "on" : "off", (unsigned long)stat_frames, (unsigned long)stat_render_us, vdp->status,
+           vdp->reg[0], vdp->reg[1], vdp->reg[2], vdp->reg[3], vdp->reg[4], vdp->reg[5], vdp->reg[6], vdp->reg[7]);
+}
@@ -0,0 +1,43 @@
+/**
+ * TMS9918A emulation mode
+ *
+ * /VDP ON hands the input stream to an emulated TMS9918A (see tms9918.h)
+ * until the exit record. The stream is a sequence of port records:
+ *
+ *   'D' n data    write n bytes to the data port (n = 0 means 256)
+ *   'C' v         write v to the control port
+ *   'R' n         read n bytes from the data port and send them back
+ *   'S'           read the status register and send it back
+ *   'X'           leave the mode and restore the console
+ *
+ * Whenever VRAM or the registers have changed, the next vsync renders the
+ * 256x192 picture at 2x into the middle of the 640x480 screen, mapping the
+ * TMS colors to the closest of ours; the border shows the backdrop color.
+ */
+
+#ifndef VDP_H
+#define VDP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "transport.h"
+
+#define VDP_LEFT 64     // screen position of the scaled picture
+#define VDP_TOP  48
+
+// Record parser state for one transport; op is 0 between records
+typedef struct {
+    uint8_t op;
+    uint16_t remaining;     // data bytes left in a 'D' record
+    bool have_count;
+} VdpParser;
+
+extern bool vdp_active ;
+
+void vdp_enable(bool enable) ;
+size_t vdp_input(VdpParser *p, const uint8_t *data, size_t len, const Transport *t) ;
+void vdp_service(void) ;
+void vdp_report(void) ;
+
+#endif
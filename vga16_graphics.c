@@ -1,8 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "pico/stdlib.h"
 #include "hardware/pio.h"
 #include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
 // Our assembled programs:
 // Each gets the name <pio_filename.pio.h>
 #include "hsync.pio.h"
@@ -13,6 +16,9 @@
 // Font file
 #include "glcdfont.c"
 #include "font_rom_brl4.h"
+#include "glyph_cache.h"
+// Event tracing
+#include "trace.h"
 
 // VGA timing constants
 #define H_ACTIVE   655    // (active + frontporch - 1) - one cycle delay for mov
@@ -20,6 +26,10 @@
 #define RGB_ACTIVE 319    // (horizontal active)/2 - 1
 // #define RGB_ACTIVE 639 // change to this if 1 pixel/byte
 
+// Screen width/height
+#define _width 640
+#define _height 480
+
 // Length of the pixel array, and number of DMA transfers
 #define TXCOUNT 153600 // Total pixels/2 (since we have 2 pixels per byte)
 
@@ -29,6 +39,26 @@
 unsigned char vga_data_array[TXCOUNT];
 char * address_pointer = &vga_data_array[0] ;
 
+// DMA channel that streams the pixel array, and a count of completed
+// frames. Channel 0 finishes its block once the last pixel of the frame
+// has been handed to the RGB machine, i.e. at the start of vertical
+// blanking, so its completion interrupt doubles as our vsync.
+static int rgb_chan_0 ;
+volatile uint32_t vga_frame_count = 0 ;
+volatile uint32_t vga_frame_end_us = 0 ;   // timer value at the last vsync
+
+// Lowest and highest framebuffer row written since vga_reset_touched_rows()
+short vga_touched_top = _height, vga_touched_bottom = -1 ;
+
+#if VGA_DAMAGE_TRACKING
+// Damage tracker: for every row, the leftmost and rightmost pixel written
+// since the last vga_damage_clear() (x0 > x1 means the row is clean), plus
+// the range of dirty rows so queries and clears only walk what changed.
+bool vga_damage_enabled = false ;
+static short damage_x0[_height], damage_x1[_height] ;
+static short damage_top = _height, damage_bottom = -1 ;
+#endif
+
 // Bit masks for drawPixel routine
 #define TOPMASK 0b00001111
 #define BOTTOMMASK 0b11110000
@@ -46,9 +76,128 @@ char * address_pointer = &vga_data_array[0] ;
 unsigned short cursor_y, cursor_x, textsize ;
 char textcolor, textbgcolor, wrap;
 
-// Screen width/height
-#define _width 640
-#define _height 480
+// Vsync (end of active video) interrupt
+static void __not_in_flash_func(vga_frame_irq)(void) {
+    dma_hw->ints0 = 1u << rgb_chan_0 ;
+    vga_frame_end_us = timer_hw->timerawl ;
+    vga_frame_count++ ;
+    TRACE(TRACE_VSYNC, vga_frame_count) ;
+}
+
+// Row currently being scanned out (0-479), or -1 during vertical blanking.
+// Derived from how far the pixel DMA has got through the frame.
+int vga_scanline() {
+    if ((uint32_t)(timer_hw->timerawl - vga_frame_end_us) < VGA_VBLANK_US) return -1 ;
+    int row = (TXCOUNT - (int)dma_hw->ch[rgb_chan_0].transfer_count) / (_width / 2) ;
+    return (row < _height) ? row : _height - 1 ;
+}
+
+void vga_reset_touched_rows() {
+    vga_touched_top = _height ;
+    vga_touched_bottom = -1 ;
+}
+
+// Record that pixels x0..x1 of row y (already clipped) have been written
+static inline void mark_span(short y, short x0, short x1) {
+    if (y < vga_touched_top) vga_touched_top = y ;
+    if (y > vga_touched_bottom) vga_touched_bottom = y ;
+#if VGA_DAMAGE_TRACKING
+    if (vga_damage_enabled) {
+        if (x0 < damage_x0[y]) damage_x0[y] = x0 ;
+        if (x1 > damage_x1[y]) damage_x1[y] = x1 ;
+        if (y < damage_top) damage_top = y ;
+        if (y > damage_bottom) damage_bottom = y ;
+    }
+#endif
+}
+
+// Record that rows y0..y1, pixels x0..x1 (already clipped), have been
+// written: the touched rows at once, the damage row by row only when on
+static void mark_rect(short x0, short y0, short x1, short y1) {
+    if (y0 < vga_touched_top) vga_touched_top = y0 ;
+    if (y1 > vga_touched_bottom) vga_touched_bottom = y1 ;
+#if VGA_DAMAGE_TRACKING
+    if (vga_damage_enabled) {
+        if (y0 < damage_top) damage_top = y0 ;
+        if (y1 > damage_bottom) damage_bottom = y1 ;
+        for (short row = y0; row <= y1; row++) {
+            if (x0 < damage_x0[row]) damage_x0[row] = x0 ;
+            if (x1 > damage_x1[row]) damage_x1[row] = x1 ;
+        }
+    }
+#endif
+}
+
+// Record a written rectangle (clipped to the screen here)
+void vga_damage_rect(short x, short y, short w, short h) {
+    short x1 = x + w - 1, y1 = y + h - 1 ;
+    if (x < 0) x = 0 ;
+    if (y < 0) y = 0 ;
+    if (x1 > _width - 1) x1 = _width - 1 ;
+    if (y1 > _height - 1) y1 = _height - 1 ;
+    if (x > x1 || y > y1) return ;
+    mark_rect(x, y, x1, y1) ;
+}
+
+#if VGA_DAMAGE_TRACKING
+void vga_damage_clear() {
+    for (short y = damage_top; y <= damage_bottom; y++) {
+        damage_x0[y] = _width ;
+        damage_x1[y] = -1 ;
+    }
+    damage_top = _height ;
+    damage_bottom = -1 ;
+}
+
+void vga_damage_enable(bool enable) {
+    if (enable && !vga_damage_enabled) {
+        // Mark everything clean before we start tracking
+        damage_top = 0 ;
+        damage_bottom = _height - 1 ;
+        vga_damage_clear() ;
+    }
+    vga_damage_enabled = enable ;
+}
+
+// Dirty span of one row. Returns false if the row is clean.
+bool vga_damage_row(short y, short *x0, short *x1) {
+    if (y < damage_top || y > damage_bottom || damage_x1[y] < 0) return false ;
+    *x0 = damage_x0[y] ;
+    *x1 = damage_x1[y] ;
+    return true ;
+}
+
+// Coalesce the per-row spans into at most max rectangles. Consecutive dirty
+// rows whose spans overlap share a rectangle; when the list is full, the
+// last rectangle grows to cover the remaining damage.
+int vga_damage_rects(VgaRect *rects, int max) {
+    int n = 0 ;
+    bool open = false ;
+    for (short y = damage_top; y <= damage_bottom; y++) {
+        short x0 = damage_x0[y], x1 = damage_x1[y] ;
+        if (x1 < 0) {
+            open = false ;
+            continue ;
+        }
+        VgaRect *r = (n > 0) ? &rects[n - 1] : NULL ;
+        if (r && ((open && x0 <= r->x + r->w && x1 >= r->x - 1) || n == max)) {
+            short left = (x0 < r->x) ? x0 : r->x ;
+            short right = (x1 > r->x + r->w - 1) ? x1 : r->x + r->w - 1 ;
+            r->x = left ;
+            r->w = right - left + 1 ;
+            r->h = y - r->y + 1 ;
+        } else {
+            rects[n].x = x0 ;
+            rects[n].y = y ;
+            rects[n].w = x1 - x0 + 1 ;
+            rects[n].h = 1 ;
+            n++ ;
+        }
+        open = true ;
+    }
+    return n ;
+}
+#endif
 
 void initVGA() {
         // Choose which PIO instance to use (there are two instances, each with 4 state machines)
@@ -87,7 +236,7 @@ void initVGA() {
     /////////////////////////////////////////////////////////////////////////////////////////////////////
 
     // DMA channels - 0 sends color data, 1 reconfigures and restarts 0
-    int rgb_chan_0 = dma_claim_unused_channel(true);
+    rgb_chan_0 = dma_claim_unused_channel(true);
     int rgb_chan_1 = dma_claim_unused_channel(true);
 
     // Channel Zero (sends color data to PIO VGA machine)
@@ -123,6 +272,11 @@ void initVGA() {
         false                               // Don't start immediately.
     );
 
+    // Interrupt when channel 0 finishes a frame (used as vsync)
+    dma_channel_set_irq0_enabled(rgb_chan_0, true);
+    irq_set_exclusive_handler(DMA_IRQ_0, vga_frame_irq);
+    irq_set_enabled(DMA_IRQ_0, true);
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////
     /////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -148,24 +302,11 @@ void initVGA() {
 }
 
 
-// A function for drawing a pixel with a specified color.
-// Note that because information is passed to the PIO state machines through
-// a DMA channel, we only need to modify the contents of the array and the
-// pixels will be automatically updated on the screen.
-void drawPixel(short x, short y, char color) {
-    // Range checks (640x480 display)
-    if (x > 639) x = 639 ;
-    if (x < 0) x = 0 ;
-    if (y < 0) y = 0 ;
-    if (y > 479) y = 479 ;
-    //if((x > 639) | (x < 0) | (y > 479) | (y < 0) ) return;
-
+// Write one pixel, no range checks and no tracking
+static inline void put_pixel(short x, short y, char color) {
     // Which pixel is it?
     int pixel = ((640 * y) + x) ;
 
-    // Removed debugging information
-    // printf("Setting pixel at (%d, %d) to color %d\n", x, y, color);
-
     // Is this pixel stored in the first 4 bits
     // of the vga data array index, or the second
     // 4 bits? Check, then mask.
@@ -177,16 +318,58 @@ void drawPixel(short x, short y, char color) {
     }
 }
 
+static inline short clamp_x(short x) {
+    return x < 0 ? 0 : (x > _width - 1 ? _width - 1 : x) ;
+}
+
+static inline short clamp_y(short y) {
+    return y < 0 ? 0 : (y > _height - 1 ? _height - 1 : y) ;
+}
+
+// A pixel for the primitives below, which report what they wrote once,
+// with damage_box(), instead of per pixel
+static inline void plot(short x, short y, char color) {
+    put_pixel(clamp_x(x), clamp_y(y), color) ;
+}
+
+// Record the box with corners (x0, y0) and (x1, y1), clamped to the screen
+// the way plot() clamps its pixels, so it covers everything they wrote
+static void damage_box(short x0, short y0, short x1, short y1) {
+    if (x0 > x1) swap(x0, x1) ;
+    if (y0 > y1) swap(y0, y1) ;
+    x0 = clamp_x(x0) ; x1 = clamp_x(x1) ;
+    y0 = clamp_y(y0) ; y1 = clamp_y(y1) ;
+    mark_rect(x0, y0, x1, y1) ;
+}
+
+// A function for drawing a pixel with a specified color.
+// Note that because information is passed to the PIO state machines through
+// a DMA channel, we only need to modify the contents of the array and the
+// pixels will be automatically updated on the screen.
+void drawPixel(short x, short y, char color) {
+    // Range checks (640x480 display)
+    x = clamp_x(x) ;
+    y = clamp_y(y) ;
+
+    // Track what was written (latency measurement, damage tracking)
+    mark_span(y, x, x) ;
+    put_pixel(x, y, color) ;
+}
+
 void drawVLine(short x, short y, short h, char color) {
+    if (h <= 0) return ;
     for (short i=y; i<(y+h); i++) {
-        drawPixel(x, i, color) ;
+        plot(x, i, color) ;
     }
+    damage_box(x, y, x, y + h - 1) ;
 }
 
 void drawHLine(short x, short y, short w, char color) {
+    if (w <= 0) return ;
     for (short i=x; i<(x+w); i++) {
-        drawPixel(i, y, color) ;
+        plot(i, y, color) ;
     }
+    damage_box(x, y, x + w - 1, y) ;
 }
 
 // Bresenham's algorithm - thx wikipedia and thx Bruce!
@@ -203,6 +386,7 @@ void drawLine(short x0, short y0, short x1, short y1, char color) {
  *          the top-left of the screen is 0. It increases to the bottom.
  *      color: 3-bit color value for line
  */
+      damage_box(x0, y0, x1, y1);
       short steep = abs(y1 - y0) > abs(x1 - x0);
       if (steep) {
         swap(x0, y0);
@@ -229,9 +413,9 @@ void drawLine(short x0, short y0, short x1, short y1, char color) {
 
       for (; x0<=x1; x0++) {
         if (steep) {
-          drawPixel(y0, x0, color);
+          plot(y0, x0, color);
         } else {
-          drawPixel(x0, y0, color);
+          plot(x0, y0, color);
         }
         err -= dy;
         if (err < 0) {
@@ -279,10 +463,11 @@ void drawCircle(short x0, short y0, short r, char color) {
   short x = 0;
   short y = r;
 
-  drawPixel(x0  , y0+r, color);
-  drawPixel(x0  , y0-r, color);
-  drawPixel(x0+r, y0  , color);
-  drawPixel(x0-r, y0  , color);
+  damage_box(x0 - r, y0 - r, x0 + r, y0 + r);
+  plot(x0  , y0+r, color);
+  plot(x0  , y0-r, color);
+  plot(x0+r, y0  , color);
+  plot(x0-r, y0  , color);
 
   while (x<y) {
     if (f >= 0) {
@@ -294,14 +479,14 @@ void drawCircle(short x0, short y0, short r, char color) {
     ddF_x += 2;
     f += ddF_x;
 
-    drawPixel(x0 + x, y0 + y, color);
-    drawPixel(x0 - x, y0 + y, color);
-    drawPixel(x0 + x, y0 - y, color);
-    drawPixel(x0 - x, y0 - y, color);
-    drawPixel(x0 + y, y0 + x, color);
-    drawPixel(x0 - y, y0 + x, color);
-    drawPixel(x0 + y, y0 - x, color);
-    drawPixel(x0 - y, y0 - x, color);
+    plot(x0 + x, y0 + y, color);
+    plot(x0 - x, y0 + y, color);
+    plot(x0 + x, y0 - y, color);
+    plot(x0 - x, y0 - y, color);
+    plot(x0 + y, y0 + x, color);
+    plot(x0 - y, y0 + x, color);
+    plot(x0 + y, y0 - x, color);
+    plot(x0 - y, y0 - x, color);
   }
 }
 
@@ -313,6 +498,7 @@ void drawCircleHelper( short x0, short y0, short r, unsigned char cornername, ch
   short x     = 0;
   short y     = r;
 
+  damage_box(x0 - r, y0 - r, x0 + r, y0 + r);
   while (x<y) {
     if (f >= 0) {
       y--;
@@ -323,20 +509,20 @@ void drawCircleHelper( short x0, short y0, short r, unsigned char cornername, ch
     ddF_x += 2;
     f     += ddF_x;
     if (cornername & 0x4) {
-      drawPixel(x0 + x, y0 + y, color);
-      drawPixel(x0 + y, y0 + x, color);
+      plot(x0 + x, y0 + y, color);
+      plot(x0 + y, y0 + x, color);
     }
     if (cornername & 0x2) {
-      drawPixel(x0 + x, y0 - y, color);
-      drawPixel(x0 + y, y0 - x, color);
+      plot(x0 + x, y0 - y, color);
+      plot(x0 + y, y0 - x, color);
     }
     if (cornername & 0x8) {
-      drawPixel(x0 - y, y0 + x, color);
-      drawPixel(x0 - x, y0 + y, color);
+      plot(x0 - y, y0 + x, color);
+      plot(x0 - x, y0 + y, color);
     }
     if (cornername & 0x1) {
-      drawPixel(x0 - y, y0 - x, color);
-      drawPixel(x0 - x, y0 - y, color);
+      plot(x0 - y, y0 - x, color);
+      plot(x0 - x, y0 - y, color);
     }
   }
 }
@@ -444,15 +630,142 @@ void fillRect(short x, short y, short w, short h, char color) {
 
   // tft_setAddrWindow(x, y, x+w-1, y+h-1);
 
+  if (w <= 0 || h <= 0) return;
   for(int i=x; i<(x+w); i++) {
     for(int j=y; j<(y+h); j++) {
-        drawPixel(i, j, color);
+        plot(i, j, color);
     }
   }
+  damage_box(x, y, x + w - 1, y + h - 1);
 }
 
-// Draw a character
-void drawChar(short x, short y, unsigned char c, char color, char bg, unsigned char size) {
+// Copy h full-width rows from src_y to dst_y. The rows may overlap, so a
+// scroll is a single memmove of the band instead of a redraw.
+void vga_move_rows(short dst_y, short src_y, short h) {
+    if (h <= 0 || dst_y < 0 || src_y < 0 || dst_y + h > _height || src_y + h > _height) return ;
+    memmove(&vga_data_array[dst_y * 320], &vga_data_array[src_y * 320], h * 320) ;
+    vga_damage_rect(0, dst_y, _width, h) ;
+}
+
+// Copy a w x h block of pixels from (src_x, src_y) to (dst_x, dst_y), a
+// memmove of w/2 bytes per row. The x coordinates and w must be even so
+// the rows are whole bytes. Overlapping blocks are copied in the order that
+// keeps the source intact, so a panel scrolls with one call.
+void vga_move_rect(short dst_x, short dst_y, short src_x, short src_y, short w, short h) {
+    if (w <= 0 || h <= 0 || ((dst_x | src_x | w) & 1)) return ;
+    if (dst_x < 0 || src_x < 0 || dst_y < 0 || src_y < 0) return ;
+    if (dst_x + w > _width || src_x + w > _width || dst_y + h > _height || src_y + h > _height) return ;
+    unsigned char *dst = &vga_data_array[(dst_y * 640 + dst_x) >> 1] ;
+    unsigned char *src = &vga_data_array[(src_y * 640 + src_x) >> 1] ;
+    int step = 320 ;
+    if (dst_y > src_y) {
+        // Moving down: start at the bottom row
+        dst += (h - 1) * 320 ;
+        src += (h - 1) * 320 ;
+        step = -320 ;
+    }
+    for (int i = 0; i < h; i++) {
+        memmove(dst, src, w >> 1) ;
+        dst += step ;
+        src += step ;
+    }
+    vga_damage_rect(dst_x, dst_y, w, h) ;
+}
+
+// Change every pixel of color from to color to inside a rectangle. A
+// 256-entry table maps both nibbles of a byte at once, so the pixel pairs
+// are rewritten in one streaming pass, and a full-width band is a single
+// loop over its bytes. Only an odd pixel at either end is done by nibble.
+void vga_recolor(short x, short y, short w, short h, char from, char to) {
+    if (x < 0) { w += x ; x = 0 ; }
+    if (y < 0) { h += y ; y = 0 ; }
+    if (x + w > _width) w = _width - x ;
+    if (y + h > _height) h = _height - y ;
+    if (w <= 0 || h <= 0 || from == to) return ;
+
+    unsigned char lut[256] ;
+    for (int i = 0; i < 256; i++) {
+        unsigned char lo = i & 0x0f, hi = i >> 4 ;
+        if (lo == from) lo = to ;
+        if (hi == from) hi = to ;
+        lut[i] = (hi << 4) | lo ;
+    }
+
+    short x0 = x, x1 = x + w ;      // pixels x0..x1-1
+    if ((x0 == 0) && (x1 == _width)) {
+        unsigned char *p = &vga_data_array[y * 320] ;
+        for (int i = 0; i < h * 320; i++) p[i] = lut[p[i]] ;
+    } else {
+        for (short row = y; row < y + h; row++) {
+            unsigned char *line = &vga_data_array[row * 320] ;
+            short first = x0, last = x1 ;
+            if (first & 1) {        // odd pixel: the high nibble
+                if ((line[first >> 1] >> 4) == from) line[first >> 1] = (line[first >> 1] & 0x0f) | (to << 4) ;
+                first++ ;
+            }
+            if (last & 1) {         // even pixel alone at the end: the low nibble
+                last-- ;
+                if ((line[last >> 1] & 0x0f) == from) line[last >> 1] = (line[last >> 1] & 0xf0) | to ;
+            }
+            for (short b = first >> 1; b < (last >> 1); b++) line[b] = lut[line[b]] ;
+        }
+    }
+    vga_damage_rect(x, y, w, h) ;
+}
+
+// XOR overlay: one rectangle with every pixel inverted in place (color ^ 15),
+// which a second XOR undoes, so a text cursor costs a few bytes per blink
+// and never needs the cell under it redrawn. Anything drawing where the
+// overlay might be calls vga_overlay_hide first.
+static short overlay_x, overlay_y, overlay_w, overlay_h ;
+bool vga_overlay_visible = false ;
+
+static void overlay_xor(void) {
+    for (short row = overlay_y; row < overlay_y + overlay_h; row++) {
+        unsigned char *p = &vga_data_array[(row * 640 + overlay_x) >> 1] ;
+        for (short b = 0; b < (overlay_w >> 1); b++) p[b] ^= 0xff ;
+    }
+    vga_damage_rect(overlay_x, overlay_y, overlay_w, overlay_h) ;
+}
+
+// Show the overlay over a rectangle with even x and w, moving it if shown
+void vga_overlay_show(short x, short y, short w, short h) {
+    if (vga_overlay_visible && x == overlay_x && y == overlay_y && w == overlay_w && h == overlay_h) return ;
+    vga_overlay_hide() ;
+    if (x < 0 || y < 0 || ((x | w) & 1) || x + w > _width || y + h > _height || w <= 0 || h <= 0) return ;
+    overlay_x = x ; overlay_y = y ; overlay_w = w ; overlay_h = h ;
+    overlay_xor() ;
+    vga_overlay_visible = true ;
+}
+
+void vga_overlay_hide(void) {
+    if (!vga_overlay_visible) return ;
+    overlay_xor() ;
+    vga_overlay_visible = false ;
+}
+
+// Fill h full-width rows with one color, two pixels per byte
+void vga_fill_rows(short y, short h, char color) {
+    if (y < 0) { h += y ; y = 0 ; }
+    if (y + h > _height) h = _height - y ;
+    if (h <= 0) return ;
+    memset(&vga_data_array[y * 320], (color << 4) | color, h * 320) ;
+    vga_damage_rect(0, y, _width, h) ;
+}
+
+// The six columns of a 5x7 font glyph, bit j being row j, the sixth blank.
+// Bold ORs each column into the next one.
+static inline void glyph_columns(unsigned char c, bool bold, unsigned char cols[6]) {
+  const unsigned char *glyph = &font[c * 5] ;
+  cols[0] = glyph[0] ;
+  for (int i = 1; i < 5; i++) {
+    cols[i] = glyph[i] ;
+    if (bold) cols[i] |= glyph[i - 1] ;
+  }
+  cols[5] = bold ? glyph[4] : 0 ;
+}
+
+static void drawColumns(short x, short y, const unsigned char cols[6], char color, char bg, unsigned char size) {
     char i, j;
   if((x >= _width)            || // Clip right
      (y >= _height)           || // Clip bottom
@@ -461,21 +774,17 @@ void drawChar(short x, short y, unsigned char c, char color, char bg, unsigned c
     return;
 
   for (i=0; i<6; i++ ) {
-    unsigned char line;
-    if (i == 5)
-      line = 0x0;
-    else
-      line = pgm_read_byte(font+(c*5)+i);
+    unsigned char line = cols[i];
     for ( j = 0; j<8; j++) {
       if (line & 0x1) {
         if (size == 1) // default size
-          drawPixel(x+i, y+j, color);
+          plot(x+i, y+j, color);
         else {  // big size
           fillRect(x+(i*size), y+(j*size), size, size, color);
         }
       } else if (bg != color) {
         if (size == 1) // default size
-          drawPixel(x+i, y+j, bg);
+          plot(x+i, y+j, bg);
         else {  // big size
           fillRect(x+i*size, y+j*size, size, size, bg);
         }
@@ -483,6 +792,19 @@ void drawChar(short x, short y, unsigned char c, char color, char bg, unsigned c
       line >>= 1;
     }
   }
+  if (size == 1) damage_box(x, y, x + 5, y + 7);
+}
+
+// Draw a character. An opaque size 1 character at an even x is a 6x8 cell,
+// copied from the glyph cache.
+void drawChar(short x, short y, unsigned char c, char color, char bg, unsigned char size) {
+  if (size == 1 && bg != color && !(x & 1) && x >= 0 && y >= 0 && x <= _width - 6 && y <= _height - 8) {
+    drawCharCell6(x, y, c, color, bg, 0);
+    return;
+  }
+  unsigned char cols[6];
+  glyph_columns(c, false, cols);
+  drawColumns(x, y, cols, color, bg, size);
 }
 
 
@@ -570,23 +892,146 @@ inline void setTextColorBig(char color, char background) {
   textcolor   = color;
   textbgcolor = background;
 }
+
+// Expanded glyphs: for each row, the bytes (two pixels each, the left one
+// in the low nibble) that go into the pixel array, with the style applied.
+// The 8x16 font takes 4 bytes per row, the 5x7 font 3.
+static void expand_big(unsigned char *rows, unsigned char c, char color, char bg, unsigned char style, unsigned short invert_rows) {
+    unsigned char pairs[4] ;
+    pairs[0] = (bg << 4) | bg ;
+    pairs[1] = (color << 4) | bg ;
+    pairs[2] = (bg << 4) | color ;
+    pairs[3] = (color << 4) | color ;
+
+    const char *glyph = &bigFont[(c & 0x7f) * 16] ;
+    for (int i = 0; i < 16; i++) {
+        unsigned char line = glyph[i] ;
+        if (style & VGA_STYLE_BOLD) line |= line >> 1 ;
+        if ((style & VGA_STYLE_UNDERLINE) && i == 15) line = 0xff ;
+        if (invert_rows & (1u << i)) line = ~line ;
+        rows[0] = pairs[line >> 6] ;
+        rows[1] = pairs[(line >> 4) & 3] ;
+        rows[2] = pairs[(line >> 2) & 3] ;
+        rows[3] = pairs[line & 3] ;
+        rows += 4 ;
+    }
+}
+
+// The font is stored by column, so each row gathers one bit from each of
+// the six columns; bold and underline are applied to the columns first.
+static void expand_5x7(unsigned char *rows, unsigned char c, char color, char bg, unsigned char style) {
+    unsigned char pairs[4] ;
+    pairs[0] = (bg << 4) | bg ;
+    pairs[1] = (color << 4) | bg ;
+    pairs[2] = (bg << 4) | color ;
+    pairs[3] = (color << 4) | color ;
+
+    unsigned char cols[6] ;
+    glyph_columns(c, style & VGA_STYLE_BOLD, cols) ;
+    if (style & VGA_STYLE_UNDERLINE) {
+        for (int i = 0; i < 6; i++) cols[i] |= 0x80 ;
+    }
+    for (int j = 0; j < 8; j++) {
+        rows[0] = pairs[(((cols[0] >> j) & 1) << 1) | ((cols[1] >> j) & 1)] ;
+        rows[1] = pairs[(((cols[2] >> j) & 1) << 1) | ((cols[3] >> j) & 1)] ;
+        rows[2] = pairs[(((cols[4] >> j) & 1) << 1) | ((cols[5] >> j) & 1)] ;
+        rows += 3 ;
+    }
+}
+
+// The expanded glyph from the cache, expanded into it on a miss (or into
+// scratch when the cache is off). Reverse is folded into the colors, so
+// reversed text shares entries with the same colors the other way round.
+static const unsigned char *cached_glyph(int font, unsigned char c, char color, char bg, unsigned char style, unsigned char *scratch) {
+    if (style & VGA_STYLE_REVERSE) {
+        char t = color ; color = bg ; bg = t ;
+        style &= ~VGA_STYLE_REVERSE ;
+    }
+    if (font == GLYPH_FONT_BIG) c &= 0x7f ;
+    bool hit ;
+    unsigned char *rows = glyph_cache_find(glyph_key(font, c, color, bg, style), &hit) ;
+    if (rows == NULL) rows = scratch ;
+    if (!hit) {
+        if (font == GLYPH_FONT_BIG) expand_big(rows, c, color, bg, style, 0) ;
+        else expand_5x7(rows, c, color, bg, style) ;
+    }
+    return rows ;
+}
+
+// Copy h expanded rows of 4 bytes to an even x
+static void copy_rows4(short x, short y, const unsigned char *rows, int h) {
+    unsigned char *row = &vga_data_array[(y * 640 + x) >> 1] ;
+    for (int i = 0; i < h; i++) {
+        memcpy(row, rows + 4 * i, 4) ;
+        row += 320 ;
+    }
+}
+
 //=================================================
 // added 10/11/2023 brl4
-// Draw a character
+// Draw a character. Opaque at an even x, it is copied from the glyph cache
+// (the first 15 rows of the 8x16 cell).
 void drawCharBig(short x, short y, unsigned char c, char color, char bg) {
   char i, j ;
   unsigned char line; 
+  if (bg != color && c < 128 && !(x & 1) && x >= 0 && y >= 0 && x <= _width - 8 && y <= _height - 15) {
+    unsigned char scratch[GLYPH_CACHE_SLOT] ;
+    copy_rows4(x, y, cached_glyph(GLYPH_FONT_BIG, c, color, bg, 0, scratch), 15) ;
+    vga_damage_rect(x, y, 8, 15) ;
+    return ;
+  }
   for (i=0; i<15; i++ ) {   
     line = pgm_read_byte(bigFont+((int)c*16)+i);
     for ( j = 0; j<8; j++) {
       if (line & 0x80) {
-        drawPixel(x+j, y+i, color);
+        plot(x+j, y+i, color);
       } else if (bg!=color){
-        drawPixel(x+j, y+i, bg);
+        plot(x+j, y+i, bg);
       }
       line <<= 1;
     }
   }
+  damage_box(x, y, x + 7, y + 14);
+}
+
+// Draw an 8x16 character cell from the big font straight into the pixel
+// array, four bytes (two pixels each) per row. x must be even. The styled
+// glyph comes expanded from the glyph cache, so styled text costs the same
+// as plain. Rows whose bit is set in invert_rows are drawn inverted (used
+// for text cursors); those cells are expanded on the spot.
+void drawCharCell(short x, short y, unsigned char c, char color, char bg, unsigned char style, unsigned short invert_rows) {
+    if ((x < 0) || (y < 0) || (x > _width - 8) || (y > _height - 16)) return ;
+    unsigned char scratch[GLYPH_CACHE_SLOT] ;
+    const unsigned char *rows ;
+    if (invert_rows) {
+        if (style & VGA_STYLE_REVERSE) {
+            char t = color ; color = bg ; bg = t ;
+        }
+        expand_big(scratch, c, color, bg, style, invert_rows) ;
+        rows = scratch ;
+    } else {
+        rows = cached_glyph(GLYPH_FONT_BIG, c, color, bg, style, scratch) ;
+    }
+    copy_rows4(x, y, rows, 16) ;
+    vga_damage_rect(x, y, 8, 16) ;
+}
+
+// Draw a 6x8 character cell from the 5x7 font straight into the pixel
+// array, three bytes (two pixels each) per row, copied from the glyph
+// cache. x must be even.
+void drawCharCell6(short x, short y, unsigned char c, char color, char bg, unsigned char style) {
+    if ((x < 0) || (y < 0) || (x > _width - 6) || (y > _height - 8)) return ;
+    unsigned char scratch[GLYPH_CACHE_SLOT] ;
+    const unsigned char *rows = cached_glyph(GLYPH_FONT_5X7, c, color, bg, style, scratch) ;
+    unsigned char *row = &vga_data_array[(y * 640 + x) >> 1] ;
+    for (int j = 0; j < 8; j++) {
+        row[0] = rows[0] ;
+        row[1] = rows[1] ;
+        row[2] = rows[2] ;
+        rows += 3 ;
+        row += 320 ;
+    }
+    vga_damage_rect(x, y, 6, 8) ;
 }
 
 inline void writeStringBig(char* str){
@@ -603,20 +1048,14 @@ inline void writeStringBig(char* str){
 
 inline void writeStringBold(char* str){
 /* Print text onto screen
- * Call tft_setCursor(), tft_setTextColorBig()
- *  as necessary before printing
- */
-   /* Print text onto screen
  * Call tft_setCursor(), tft_setTextColor(), tft_setTextSize()
  *  as necessary before printing
  */
-    char temp_bg ;
-    temp_bg = textbgcolor;
+    unsigned char cols[6] ;
     while (*str){
         char c = *str++;
-        drawChar(cursor_x, cursor_y, c, textcolor, textbgcolor, textsize);
-        drawChar(cursor_x+1, cursor_y, c, textcolor, textcolor, textsize);
+        glyph_columns(c, true, cols) ;
+        drawColumns(cursor_x, cursor_y, cols, textcolor, textbgcolor, textsize);
         cursor_x += 7 * textsize ;
     }
-    textbgcolor = temp_bg ;
 }
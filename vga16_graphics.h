@@ -33,6 +33,39 @@ enum colors {BLACK, DARK_GREEN, MED_GREEN, GREEN,
             RED, DARK_ORANGE, ORANGE, YELLOW, 
             MAGENTA, PINK, LIGHT_PINK, WHITE} ;
 
+// Video timing: 800 pixel clocks per line at 25 MHz, 525 lines per frame,
+// 480 of them active
+#define VGA_LINE_US   32
+#define VGA_FRAME_US  (525 * VGA_LINE_US)
+#define VGA_VBLANK_US (45 * VGA_LINE_US)
+
+// Completed frames, advanced at the start of every vertical blanking interval
+extern volatile uint32_t vga_frame_count ;
+extern volatile uint32_t vga_frame_end_us ;
+int vga_scanline(void) ;
+
+// Rows written by the drawing primitives since the last reset
+extern short vga_touched_top, vga_touched_bottom ;
+void vga_reset_touched_rows(void) ;
+
+// Optional damage tracker: every primitive records the area it writes (its
+// bounding box, marked once per call) as per-row x spans, which can be read
+// back per row or coalesced into a short list of rectangles. Off until
+// vga_damage_enable(true); build with -DVGA_DAMAGE_TRACKING=0 to remove it
+// (and its 2 kB of tables) entirely.
+#ifndef VGA_DAMAGE_TRACKING
+#define VGA_DAMAGE_TRACKING 1
+#endif
+typedef struct { short x, y, w, h; } VgaRect ;
+void vga_damage_rect(short x, short y, short w, short h) ;
+#if VGA_DAMAGE_TRACKING
+extern bool vga_damage_enabled ;
+void vga_damage_enable(bool enable) ;
+void vga_damage_clear(void) ;
+bool vga_damage_row(short y, short *x0, short *x1) ;
+int vga_damage_rects(VgaRect *rects, int max) ;
+#endif
+
 // VGA primitives - usable in main
 void initVGA(void) ;
 void drawPixel(short x, short y, char color) ;
@@ -47,6 +80,15 @@ void fillCircleHelper(short x0, short y0, short r, unsigned char cornername, sho
 void drawRoundRect(short x, short y, short w, short h, short r, char color) ;
 void fillRoundRect(short x, short y, short w, short h, short r, char color) ;
 void fillRect(short x, short y, short w, short h, char color) ;
+void vga_move_rows(short dst_y, short src_y, short h) ;
+void vga_fill_rows(short y, short h, char color) ;
+void vga_move_rect(short dst_x, short dst_y, short src_x, short src_y, short w, short h) ;
+void vga_recolor(short x, short y, short w, short h, char from, char to) ;
+
+// One XOR-inverted rectangle (the text cursor); hide it before drawing there
+extern bool vga_overlay_visible ;
+void vga_overlay_show(short x, short y, short w, short h) ;
+void vga_overlay_hide(void) ;
 void drawChar(short x, short y, unsigned char c, char color, char bg, unsigned char size) ;
 void setCursor(short x, short y);
 void setTextColor(char c);
@@ -57,6 +99,12 @@ void tft_write(unsigned char c) ;
 void writeString(char* str) ;
 // === added 10/11/2023 brl4
 void drawCharBig(short x, short y, unsigned char c, char color, char bg) ;
+// Text styles the cell blitters apply while expanding the glyph
+#define VGA_STYLE_BOLD      0x01    // each row ORed with itself one pixel right
+#define VGA_STYLE_UNDERLINE 0x02    // last row of the cell set
+#define VGA_STYLE_REVERSE   0x04    // foreground and background swapped
+void drawCharCell(short x, short y, unsigned char c, char color, char bg, unsigned char style, unsigned short invert_rows) ;
+void drawCharCell6(short x, short y, unsigned char c, char color, char bg, unsigned char style) ;
 void writeStringBig(char* str) ;
 void setTextColorBig(char, char); //works, but can use usual setTextColor2
 // 5x7 font
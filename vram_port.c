@@ -0,0 +1,175 @@
+#include <string.h>
+#include "pico/stdlib.h"
+#include "vga16_graphics.h"
+#include "cmdqueue.h"
+#include "vram_port.h"
+
+#define OP_PENDING 0xff     // DLE seen, waiting for the op byte
+
+extern unsigned char vga_data_array[] ;
+extern void console_flush(void) ;
+
+typedef struct {
+    uint8_t *memory;
+    uint32_t size;
+    PortWritten written;
+} PortRegion;
+
+// Report pixels written through the port to damage tracking and latency
+// measurement, as the drawing primitives do
+static void damage_bytes(uint32_t first, uint32_t last) {
+    short y0 = first / 320, y1 = last / 320;
+    if (y0 == y1) {
+        vga_damage_rect((first % 320) * 2, y0, (last - first) * 2 + 2, 1);
+    } else {
+        vga_damage_rect(0, y0, 640, y1 - y0 + 1);
+    }
+}
+
+// Indexed by the top two address bits
+static PortRegion regions[4] = {
+    { vga_data_array, 640 * 480 / 2, damage_bytes },
+};
+
+static uint32_t port_address = 0;
+static int32_t port_step = 1;
+
+void vram_port_map(uint32_t base, void *memory, uint32_t size, PortWritten written) {
+    regions[(base & PORT_REGION_MASK) >> 22].memory = memory;
+    regions[(base & PORT_REGION_MASK) >> 22].size = size;
+    regions[(base & PORT_REGION_MASK) >> 22].written = written;
+}
+
+void vram_port_begin(PortParser *p) {
+    p->op = OP_PENDING;
+    p->nargs = 0;
+}
+
+// Start of the mapped memory at the port address and how many bytes
+// follow it in the region (0 if unmapped)
+static uint8_t *port_target(uint32_t *avail) {
+    PortRegion *r = &regions[(port_address & PORT_REGION_MASK) >> 22];
+    uint32_t offset = port_address & ~PORT_REGION_MASK;
+    if (r->memory == NULL || offset >= r->size) {
+        *avail = 0;
+        return NULL;
+    }
+    *avail = r->size - offset;
+    return r->memory + offset;
+}
+
+// Commands still queued and console text not yet drawn came in before the
+// port op, so they go to the screen first; console_flush also takes the
+// cursor out of the framebuffer. Port reads then see the finished picture,
+// and nothing drawn later paints over what a port write put there.
+static void port_sync() {
+    cmdqueue_flush();
+    console_flush();
+}
+
+static size_t port_write(const uint8_t *data, size_t len) {
+    port_sync();
+    uint32_t avail;
+    uint8_t *dest = port_target(&avail);
+    uint32_t start = port_address;
+    size_t n = len;
+
+    if (port_step == 1) {
+        if (dest != NULL) {
+            memcpy(dest, data, n < avail ? n : avail);
+        }
+        port_address += n;
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            dest = port_target(&avail);
+            if (dest != NULL) *dest = data[i];
+            port_address += port_step;
+        }
+    }
+
+    // Tell the region's owner which offsets may have changed
+    PortRegion *r = &regions[(start & PORT_REGION_MASK) >> 22];
+    if (r->written != NULL && n > 0) {
+        uint32_t end = start + (uint32_t)port_step * (n - 1);
+        uint32_t lo = (port_step > 0) ? start : end, hi = (port_step > 0) ? end : start;
+        lo = ((lo & PORT_REGION_MASK) == (start & PORT_REGION_MASK)) ? lo & ~PORT_REGION_MASK : 0;
+        hi = ((hi & PORT_REGION_MASK) == (start & PORT_REGION_MASK)) ? hi & ~PORT_REGION_MASK : r->size - 1;
+        if (hi >= r->size) hi = r->size - 1;
+        if (lo <= hi) r->written(lo, hi);
+    }
+    return n;
+}
+
+static void port_read(const Transport *t, uint32_t count) {
+    port_sync();
+    uint8_t chunk[64];
+    while (count > 0) {
+        uint32_t avail;
+        uint8_t *src = port_target(&avail);
+        if (port_step == 1 && avail > 0) {
+            // Send straight from memory
+            uint32_t n = count < avail ? count : avail;
+            t->write((const char *)src, n);
+            port_address += n;
+            count -= n;
+            continue;
+        }
+        int n = 0;
+        while (n < (int)sizeof(chunk) && count > 0) {
+            src = port_target(&avail);
+            chunk[n++] = (src != NULL) ? *src : 0;
+            port_address += port_step;
+            count--;
+        }
+        t->write((const char *)chunk, n);
+    }
+}
+
+// Consume the bytes of an open port operation from a received run.
+// Returns how many were used; the op is closed (op == 0) when it is done.
+size_t vram_port_input(PortParser *p, const uint8_t *data, size_t len, const Transport *t) {
+    size_t i = 0;
+
+    if (p->op == OP_PENDING) {
+        if (len == 0) return 0;
+        p->op = data[i++];
+        p->nargs = 0;
+        if (p->op != 'A' && p->op != 'S' && p->op != 'W' && p->op != 'R') {
+            p->op = 0;      // unknown op: drop it and go back to text
+            return i;
+        }
+    }
+
+    // Gather the arguments
+    int need = (p->op == 'S') ? 2 : 3;
+    while (p->nargs < need && i < len) {
+        p->args[p->nargs++] = data[i++];
+        if (p->nargs == need && p->op == 'W') {
+            p->remaining = ((uint32_t)p->args[0] << 16) | (p->args[1] << 8) | p->args[2];
+        }
+    }
+    if (p->nargs < need) return i;
+
+    switch (p->op) {
+    case 'A':
+        port_address = ((uint32_t)p->args[0] << 16) | (p->args[1] << 8) | p->args[2];
+        break;
+    case 'S':
+        port_step = (int16_t)((p->args[0] << 8) | p->args[1]);
+        break;
+    case 'R':
+        port_read(t, ((uint32_t)p->args[0] << 16) | (p->args[1] << 8) | p->args[2]);
+        break;
+    case 'W':
+        if (p->remaining > 0) {
+            size_t n = len - i;
+            if (n > p->remaining) n = p->remaining;
+            i += port_write(&data[i], n);
+            p->remaining -= n;
+            if (p->remaining > 0) return i;
+        }
+        break;
+    }
+    p->op = 0;
+    return i;
+}
@@ -0,0 +1,64 @@
+/**
+ * VDP-style memory port
+ *
+ * Retro hosts are best at poking bytes, so after DLE (0x10) the input
+ * stream carries binary port operations instead of text. Multi-byte
+ * values are big-endian.
+ *
+ *   DLE 'A' a2 a1 a0       set the 24-bit port address
+ *   DLE 'S' s1 s0          set the signed 16-bit address step (default 1)
+ *   DLE 'W' n2 n1 n0 data  write n raw bytes, stepping the address
+ *   DLE 'R' n2 n1 n0       send n raw bytes back, stepping the address
+ *
+ * The address space maps the firmware's memories:
+ *
+ *   0x000000  vga_data_array (153600 bytes, two pixels per byte, the
+ *             even pixel in the low nibble)
+ *   0x400000  the consoles' cells (rows of 106 cells of 16 bits,
+ *             little-endian; console n starts at row n * its height)
+ *   0x800000  tile_map (80x30 cells)
+ *
+ * A cell is the character in its low byte and the foreground color in the
+ * low nibble of its high byte, the background in the high nibble.
+ *
+ * Every read or write first draws the commands still queued and the console
+ * text not yet on the screen, so it sees and changes the picture as of that
+ * point in the stream. Cells written in the console window are redrawn
+ * like console output.
+ *
+ * Bytes outside a mapped region are dropped (writes) or read as 0. A full
+ * screen image is DLE 'A' 0 0 0, DLE 'W' 0x02 0x58 0x00 and 153600 bytes
+ * that are copied straight from the receive buffers.
+ */
+
+#ifndef VRAM_PORT_H
+#define VRAM_PORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "transport.h"
+
+#define PORT_DLE 0x10
+
+#define PORT_VGA_BASE    0x000000
+#define PORT_SCREEN_BASE 0x400000
+#define PORT_TILES_BASE  0x800000
+#define PORT_REGION_MASK 0xc00000
+
+// Parser state for one transport; op is 0 when no operation is open
+typedef struct {
+    uint8_t op;
+    uint8_t args[3];
+    int nargs;
+    uint32_t remaining;     // data bytes left in a write
+} PortParser;
+
+// Called after a port write with the first and last offsets into the
+// region that it may have changed
+typedef void (*PortWritten)(uint32_t first, uint32_t last);
+
+void vram_port_map(uint32_t base, void *memory, uint32_t size, PortWritten written) ;
+void vram_port_begin(PortParser *p) ;
+size_t vram_port_input(PortParser *p, const uint8_t *data, size_t len, const Transport *t) ;
+
+#endif